@@ -0,0 +1,116 @@
+extends SceneTree
+## Headless benchmark for the BytecodeCompiler.
+## Run with: godot --headless --path demo -s benchmark.gd
+
+const ITERATIONS = 200
+const SOURCE_SCRIPT = "res://test_scene.gd"
+
+func _init() -> void:
+	var source := (load(SOURCE_SCRIPT) as GDScript).source_code
+	var compiler := BytecodeCompiler.new()
+	bench_compile(compiler, source, BytecodeCompiler.UNCOMPRESSED, "uncompressed")
+	bench_compile(compiler, source, BytecodeCompiler.COMPRESSED, "compressed")
+	bench_policies(source)
+	bench_small_scripts(source)
+	bench_threads(source)
+	bench_table_order(source)
+	bench_tokenize(source)
+	quit()
+
+func bench_compile(compiler: BytecodeCompiler, source: String,
+		compression: BytecodeCompiler.CompressionMode, label: String) -> void:
+	var bytes := PackedByteArray()
+	var time := Time.get_ticks_usec()
+	for i in range(ITERATIONS):
+		bytes = compiler.compile_from_string(source, compression)
+	time = Time.get_ticks_usec() - time
+	print("%-24s %8.03f us/op %8d bytes" % [label, float(time) / ITERATIONS, bytes.size()])
+
+func bench_policies(source: String) -> void:
+	var uncompressed := BytecodeCompiler.new().compile_from_string(source)
+	var policies := [
+		["level 1", 1, false, BytecodeCompiler.COMPRESSED],
+		["level 3", 3, false, BytecodeCompiler.COMPRESSED],
+		["level 9", 9, false, BytecodeCompiler.COMPRESSED],
+		["level 19", 19, false, BytecodeCompiler.COMPRESSED],
+		["level 19 + ldm", 19, true, BytecodeCompiler.COMPRESSED],
+		["auto", 3, false, BytecodeCompiler.AUTO],
+	]
+	for policy in policies:
+		var compiler := BytecodeCompiler.new()
+		compiler.compression_level = policy[1]
+		compiler.long_distance_matching = policy[2]
+		var bytes := PackedByteArray()
+		var time := Time.get_ticks_usec()
+		for i in range(ITERATIONS):
+			bytes = compiler.compile_from_string(source, policy[3])
+		time = Time.get_ticks_usec() - time
+		print("%-24s %8.03f us/op %8d bytes ratio %.03f" % [policy[0], float(time) / ITERATIONS,
+			bytes.size(), float(bytes.size()) / uncompressed.size()])
+
+func bench_small_scripts(source: String) -> void:
+	# Corpus of small scripts, one per function of the source, where the fixed cost per call matters.
+	var corpus: Array[PackedByteArray] = []
+	var compiler := BytecodeCompiler.new()
+	for chunk in source.split("\nfunc "):
+		var bytes := compiler.compile_from_string("func " + chunk if corpus.size() > 0 else chunk)
+		if not bytes.is_empty():
+			corpus.append(bytes)
+	var time := Time.get_ticks_usec()
+	for i in range(ITERATIONS):
+		for bytes in corpus:
+			bytes.slice(12).compress(FileAccess.COMPRESSION_ZSTD)
+	time = Time.get_ticks_usec() - time
+	print("%-24s %8.03f us/script" % ["engine compress", float(time) / (ITERATIONS * corpus.size())])
+	time = Time.get_ticks_usec()
+	for i in range(ITERATIONS):
+		compiler.compress_batch(corpus)
+	time = Time.get_ticks_usec() - time
+	print("%-24s %8.03f us/script" % ["bundled compress", float(time) / (ITERATIONS * corpus.size())])
+
+func bench_threads(source: String) -> void:
+	# Over 20 MB of bytecode, the size of the largest generated data scripts.
+	var large := source
+	while large.length() < 8 * 1024 * 1024:
+		large += large
+	var compiler := BytecodeCompiler.new()
+	var uncompressed := compiler.compile_from_string(large)
+	compiler.multithread_min_size = 0
+	for threads in [0, 1, 2, 4, 8]:
+		compiler.compression_threads = threads
+		var time := Time.get_ticks_usec()
+		var bytes := compiler.compress(uncompressed)
+		time = Time.get_ticks_usec() - time
+		print("%-24s %8.03f ms %8d -> %d bytes" % ["%d threads" % threads, float(time) / 1000.0,
+			uncompressed.size(), bytes.size()])
+
+func bench_table_order(source: String) -> void:
+	# Compressed size and engine load time with tables in first appearance order and reordered.
+	var compiler := BytecodeCompiler.new()
+	for reorder in [false, true]:
+		compiler.reorder_tables = reorder
+		var bytes := compiler.compile_from_string(source, BytecodeCompiler.COMPRESSED)
+		var path := "user://table_order.gdc"
+		var file := FileAccess.open(path, FileAccess.WRITE)
+		file.store_buffer(bytes)
+		file.close()
+		var time := Time.get_ticks_usec()
+		for i in range(ITERATIONS):
+			ResourceLoader.load(path, "GDScript", ResourceLoader.CACHE_MODE_IGNORE)
+		time = Time.get_ticks_usec() - time
+		print("%-24s %8.03f us/load %8d bytes" % ["reordered tables" if reorder else "first appearance",
+			float(time) / ITERATIONS, bytes.size()])
+
+func bench_tokenize(source: String) -> void:
+	# Token stream of a script of at least 10k lines, as a code editor would highlight it.
+	var large := source
+	while large.count("\n") < 10000:
+		large += "\n" + source
+	var compiler := BytecodeCompiler.new()
+	var tokens := {}
+	var time := Time.get_ticks_usec()
+	for i in range(10):
+		tokens = compiler.tokenize(large)
+	time = Time.get_ticks_usec() - time
+	print("%-24s %8.03f ms/op %8d tokens" % ["tokenize %d lines" % large.count("\n"),
+		float(time) / 10000.0, (tokens.types as PackedInt32Array).size()])
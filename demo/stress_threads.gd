@@ -0,0 +1,81 @@
+extends SceneTree
+## Headless concurrency check for the BytecodeCompiler: compiles, decompresses, verifies,
+## compares and patches a corpus from several threads at once, with one shared compiler, and
+## compares every result with the single-threaded one.
+## Run with: godot --headless --path demo -s stress_threads.gd
+
+const THREADS = 8
+const ROUNDS = 20
+const SOURCE_SCRIPT = "res://test_scene.gd"
+
+var compiler := BytecodeCompiler.new()
+var corpus: Array[String] = []
+var compiled: Array[PackedByteArray] = []
+var expected: Array[Array] = []
+
+func _init() -> void:
+	var source := (load(SOURCE_SCRIPT) as GDScript).source_code
+	# The whole script and one small script per function of it.
+	corpus.append(source)
+	var chunks := source.split("\nfunc ")
+	for i in range(1, chunks.size()):
+		corpus.append("func " + chunks[i])
+	compiler.minify_locals = true
+	compiler.stripped_calls = PackedStringArray(["print"])
+
+	for i in range(corpus.size() * 2):
+		compiled.append(compile(i))
+		if compiled[i].is_empty():
+			push_error("Corpus script %d failed to compile." % (i >> 1))
+			quit(1)
+			return
+	for i in range(compiled.size()):
+		expected.append(run(i))
+		if not is_valid(i):
+			push_error("Corpus script %d gave an invalid single-threaded result." % (i >> 1))
+			quit(1)
+			return
+
+	var time := Time.get_ticks_usec()
+	var threads: Array[Thread] = []
+	for t in range(THREADS):
+		var thread := Thread.new()
+		thread.start(run_thread.bind(t))
+		threads.append(thread)
+	var total := 0
+	for thread in threads:
+		total += thread.wait_to_finish()
+	time = Time.get_ticks_usec() - time
+
+	print("%d threads, %d runs in %.03f ms, %d mismatches" % [THREADS,
+		THREADS * ROUNDS * expected.size(), float(time) / 1000.0, total])
+	quit(1 if total > 0 else 0)
+
+# Even indices are uncompressed, odd ones compressed.
+func compile(index: int) -> PackedByteArray:
+	var mode := BytecodeCompiler.COMPRESSED if index % 2 else BytecodeCompiler.UNCOMPRESSED
+	return compiler.compile_from_string(corpus[index >> 1], mode)
+
+# Every thread-safe method on one corpus entry: the bytecode, its decompression, verification,
+# comparison with the other mode's bytecode, and a patch to the next script applied back.
+func run(index: int) -> Array:
+	var bytecode := compile(index)
+	var patch := compiler.make_patch(bytecode, compiled[(index + 2) % compiled.size()])
+	return [bytecode, compiler.decompress(bytecode), compiler.verify(bytecode),
+		compiler.compare(bytecode, compiled[index ^ 1]), patch, compiler.apply_patch(bytecode, patch)]
+
+func is_valid(index: int) -> bool:
+	var result := expected[index]
+	return not (result[1] as PackedByteArray).is_empty() and result[2] == OK \
+		and result[3] == BytecodeCompiler.SECTION_NONE and not (result[4] as PackedByteArray).is_empty() \
+		and result[5] == compiled[(index + 2) % compiled.size()]
+
+func run_thread(thread: int) -> int:
+	var mismatches := 0
+	# Each thread walks the corpus from a different offset, so different scripts overlap.
+	for _round in range(ROUNDS):
+		for i in range(expected.size()):
+			var index := (i + thread * 7) % expected.size()
+			if run(index) != expected[index]:
+				mismatches += 1
+	return mismatches
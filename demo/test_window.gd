@@ -72,18 +72,29 @@ func set_stats(file: String, type: String) -> void:
 func validate(compressed: PackedByteArray, uncompressed: PackedByteArray) -> bool:
 	var expected_compressed := FileAccess.get_file_as_bytes("test/expected_compressed.gdc")
 	var expected_uncompressed := FileAccess.get_file_as_bytes("test/expected_uncompressed.gdc")
-	# Test the bytes of each binary version.
+	var compiler := BytecodeCompiler.new()
 	if compressed.size() >= uncompressed.size():
 		push_error("compressed is the same size or bigger than the uncompressed")
 		return false
-	if uncompressed.size() != uncompressed.size():
-		push_error("actual and expected uncompressed sizes don't match")
-		return false
-	for i in range(uncompressed.size()):
-		if i <= 27 and i >= 24:
-			# ignore bytes 24, 25, 26 and 27, they seem to not be used, but may differ for some reason
-			continue
-		if uncompressed[i] != expected_uncompressed[i]:
-			push_error("actual and expected uncompressed files are different on byte = ", i)
+	for bytes in [compressed, uncompressed]:
+		var error := compiler.verify(bytes)
+		if error != OK:
+			push_error("actual bytecode failed verification: ", error_string(error))
 			return false
+	# The same source must always produce the same bytes.
+	if compiler.compile_from_string(TestScript.source_code) != uncompressed:
+		push_error("compiling the same source twice produced different uncompressed bytes")
+		return false
+	if compiler.compile_from_string(TestScript.source_code, BytecodeCompiler.COMPRESSED) != compressed:
+		push_error("compiling the same source twice produced different compressed bytes")
+		return false
+	# Compare each section of each binary version against the engine's output.
+	var section := compiler.compare(uncompressed, expected_uncompressed)
+	if section != BytecodeCompiler.SECTION_NONE:
+		push_error("actual and expected uncompressed files differ on section = ", section)
+		return false
+	section = compiler.compare(compressed, expected_compressed)
+	if section != BytecodeCompiler.SECTION_NONE:
+		push_error("actual and expected compressed files differ on section = ", section)
+		return false
 	return true
@@ -21,12 +21,17 @@
  */
 
 #include "bytecode_compiler.h"
+#include "bytecode_patch.h"
+#include "compression.h"
 #include "gdscript/gdscript_tokenizer_buffer.h"
+#include "gdscript/marshalls.h"
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
 #include <godot_cpp/classes/object.hpp>
 #include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
-#include <godot_cpp/classes/file_access.hpp>
 
 using namespace godot;
 
@@ -35,65 +40,465 @@ void BytecodeCompiler::_bind_methods() {
 			&BytecodeCompiler::compile_from_string, DEFVAL(UNCOMPRESSED));
 	ClassDB::bind_method(D_METHOD("compile_from_script", "source_script", "compression"),
 			&BytecodeCompiler::compile_from_script, DEFVAL(UNCOMPRESSED));
+	ClassDB::bind_method(D_METHOD("compile_file", "source_path", "target_path", "compression"),
+			&BytecodeCompiler::compile_file, DEFVAL(UNCOMPRESSED));
 	ClassDB::bind_method(D_METHOD("compress", "bytecode"), &BytecodeCompiler::compress);
+	ClassDB::bind_method(D_METHOD("compress_batch", "bytecodes"), &BytecodeCompiler::compress_batch);
+	ClassDB::bind_method(D_METHOD("decompress", "bytecode"), &BytecodeCompiler::decompress);
+	ClassDB::bind_method(D_METHOD("decompress_directory", "source_dir", "target_dir"),
+			&BytecodeCompiler::decompress_directory, DEFVAL(String()));
+	ClassDB::bind_method(D_METHOD("make_patch", "old_bytecode", "new_bytecode"), &BytecodeCompiler::make_patch);
+	ClassDB::bind_method(D_METHOD("apply_patch", "old_bytecode", "patch"), &BytecodeCompiler::apply_patch);
+	ClassDB::bind_method(D_METHOD("verify", "bytecode"), &BytecodeCompiler::verify);
+	ClassDB::bind_method(D_METHOD("compare", "bytecode", "other_bytecode"), &BytecodeCompiler::compare);
+	ClassDB::bind_method(D_METHOD("tokenize", "source_code"), &BytecodeCompiler::tokenize);
+	ClassDB::bind_method(D_METHOD("get_token_name", "type"), &BytecodeCompiler::get_token_name);
+	ClassDB::bind_method(D_METHOD("set_compression_level", "level"), &BytecodeCompiler::set_compression_level);
+	ClassDB::bind_method(D_METHOD("get_compression_level"), &BytecodeCompiler::get_compression_level);
+	ClassDB::bind_method(D_METHOD("set_long_distance_matching", "enabled"), &BytecodeCompiler::set_long_distance_matching);
+	ClassDB::bind_method(D_METHOD("is_long_distance_matching"), &BytecodeCompiler::is_long_distance_matching);
+	ClassDB::bind_method(D_METHOD("set_compression_threads", "threads"), &BytecodeCompiler::set_compression_threads);
+	ClassDB::bind_method(D_METHOD("get_compression_threads"), &BytecodeCompiler::get_compression_threads);
+	ClassDB::bind_method(D_METHOD("set_multithread_min_size", "size"), &BytecodeCompiler::set_multithread_min_size);
+	ClassDB::bind_method(D_METHOD("get_multithread_min_size"), &BytecodeCompiler::get_multithread_min_size);
+	ClassDB::bind_method(D_METHOD("set_reorder_tables", "enabled"), &BytecodeCompiler::set_reorder_tables);
+	ClassDB::bind_method(D_METHOD("is_reorder_tables"), &BytecodeCompiler::is_reorder_tables);
+	ClassDB::bind_method(D_METHOD("set_minify_locals", "enabled"), &BytecodeCompiler::set_minify_locals);
+	ClassDB::bind_method(D_METHOD("is_minify_locals"), &BytecodeCompiler::is_minify_locals);
+	ClassDB::bind_method(D_METHOD("get_minified_bytes"), &BytecodeCompiler::get_minified_bytes);
+	ClassDB::bind_method(D_METHOD("set_strip_debug", "enabled"), &BytecodeCompiler::set_strip_debug);
+	ClassDB::bind_method(D_METHOD("is_strip_debug"), &BytecodeCompiler::is_strip_debug);
+	ClassDB::bind_method(D_METHOD("set_stripped_calls", "calls"), &BytecodeCompiler::set_stripped_calls);
+	ClassDB::bind_method(D_METHOD("get_stripped_calls"), &BytecodeCompiler::get_stripped_calls);
+	ClassDB::bind_method(D_METHOD("set_features", "features"), &BytecodeCompiler::set_features);
+	ClassDB::bind_method(D_METHOD("get_features"), &BytecodeCompiler::get_features);
+	ClassDB::bind_method(D_METHOD("set_streaming_compression", "enabled"), &BytecodeCompiler::set_streaming_compression);
+	ClassDB::bind_method(D_METHOD("is_streaming_compression"), &BytecodeCompiler::is_streaming_compression);
+	ClassDB::bind_method(D_METHOD("set_deferred_compression", "enabled"), &BytecodeCompiler::set_deferred_compression);
+	ClassDB::bind_method(D_METHOD("is_deferred_compression"), &BytecodeCompiler::is_deferred_compression);
+	ClassDB::bind_method(D_METHOD("get_pending_compressions"), &BytecodeCompiler::get_pending_compressions);
+	ClassDB::bind_method(D_METHOD("set_deterministic_check", "enabled"), &BytecodeCompiler::set_deterministic_check);
+	ClassDB::bind_method(D_METHOD("is_deterministic_check"), &BytecodeCompiler::is_deterministic_check);
+	ClassDB::bind_method(D_METHOD("set_auto_compression_min_size", "size"), &BytecodeCompiler::set_auto_compression_min_size);
+	ClassDB::bind_method(D_METHOD("get_auto_compression_min_size"), &BytecodeCompiler::get_auto_compression_min_size);
+	ClassDB::bind_method(D_METHOD("set_auto_compression_max_ratio", "ratio"), &BytecodeCompiler::set_auto_compression_max_ratio);
+	ClassDB::bind_method(D_METHOD("get_auto_compression_max_ratio"), &BytecodeCompiler::get_auto_compression_max_ratio);
+	ClassDB::bind_method(D_METHOD("set_log_errors", "enabled"), &BytecodeCompiler::set_log_errors);
+	ClassDB::bind_method(D_METHOD("is_log_errors"), &BytecodeCompiler::is_log_errors);
+	ClassDB::bind_method(D_METHOD("get_diagnostic_count"), &BytecodeCompiler::get_diagnostic_count);
+	ClassDB::bind_method(D_METHOD("get_diagnostics"), &BytecodeCompiler::get_diagnostics);
+	ClassDB::bind_method(D_METHOD("get_diagnostic_files"), &BytecodeCompiler::get_diagnostic_files);
+	ClassDB::bind_method(D_METHOD("format_diagnostic", "index"), &BytecodeCompiler::format_diagnostic);
+	ClassDB::bind_method(D_METHOD("clear_diagnostics"), &BytecodeCompiler::clear_diagnostics);
+
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "compression_level", PROPERTY_HINT_RANGE, "1,22"), "set_compression_level", "get_compression_level");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "long_distance_matching"), "set_long_distance_matching", "is_long_distance_matching");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "compression_threads", PROPERTY_HINT_RANGE, "0,64"), "set_compression_threads", "get_compression_threads");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "multithread_min_size", PROPERTY_HINT_RANGE, "0,268435456,1,or_greater,suffix:B"), "set_multithread_min_size", "get_multithread_min_size");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "reorder_tables"), "set_reorder_tables", "is_reorder_tables");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "minify_locals"), "set_minify_locals", "is_minify_locals");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "strip_debug"), "set_strip_debug", "is_strip_debug");
+	ADD_PROPERTY(PropertyInfo(Variant::PACKED_STRING_ARRAY, "stripped_calls"), "set_stripped_calls", "get_stripped_calls");
+	ADD_PROPERTY(PropertyInfo(Variant::PACKED_STRING_ARRAY, "features"), "set_features", "get_features");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "streaming_compression"), "set_streaming_compression", "is_streaming_compression");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "deferred_compression"), "set_deferred_compression", "is_deferred_compression");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "deterministic_check"), "set_deterministic_check", "is_deterministic_check");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "auto_compression_min_size", PROPERTY_HINT_RANGE, "0,1048576,1,or_greater,suffix:B"), "set_auto_compression_min_size", "get_auto_compression_min_size");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "auto_compression_max_ratio", PROPERTY_HINT_RANGE, "0,1,0.01"), "set_auto_compression_max_ratio", "get_auto_compression_max_ratio");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "log_errors"), "set_log_errors", "is_log_errors");
+
+	ADD_SIGNAL(MethodInfo("compression_finished",
+			PropertyInfo(Variant::PACKED_BYTE_ARRAY, "bytecode"),
+			PropertyInfo(Variant::PACKED_BYTE_ARRAY, "compressed_bytecode")));
+
 	BIND_ENUM_CONSTANT(UNCOMPRESSED);
 	BIND_ENUM_CONSTANT(COMPRESSED);
+	BIND_ENUM_CONSTANT(AUTO);
+	BIND_ENUM_CONSTANT(SECTION_NONE);
+	BIND_ENUM_CONSTANT(SECTION_HEADER);
+	BIND_ENUM_CONSTANT(SECTION_IDENTIFIERS);
+	BIND_ENUM_CONSTANT(SECTION_CONSTANTS);
+	BIND_ENUM_CONSTANT(SECTION_LINES);
+	BIND_ENUM_CONSTANT(SECTION_COLUMNS);
+	BIND_ENUM_CONSTANT(SECTION_TOKENS);
+	BIND_ENUM_CONSTANT(SECTION_INVALID);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_EMPTY_SOURCE);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_INVALID_SCRIPT);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_TOKENIZER_ERROR);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_NOT_DETERMINISTIC);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_COMPILATION_FAILED);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_CANT_OPEN_FILE);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_CANT_CREATE_DIRECTORY);
+	BIND_ENUM_CONSTANT(DIAGNOSTIC_CANT_WRITE_FILE);
 }
 
-PackedByteArray BytecodeCompiler::compile_from_string(
-		const String &source_code, CompressionMode compression) {
+void BytecodeCompiler::set_compression_level(int p_level) {
+	// Levels outside of this range are either not accepted or not loadable by the engine.
+	compression_settings.level = CLAMP(p_level, 1, 22);
+}
+
+int BytecodeCompiler::get_compression_level() const {
+	return compression_settings.level;
+}
+
+void BytecodeCompiler::set_long_distance_matching(bool p_enabled) {
+	compression_settings.long_distance_matching = p_enabled;
+}
+
+bool BytecodeCompiler::is_long_distance_matching() const {
+	return compression_settings.long_distance_matching;
+}
+
+void BytecodeCompiler::set_compression_threads(int p_threads) {
+	compression_settings.threads = CLAMP(p_threads, 0, 64);
+}
+
+int BytecodeCompiler::get_compression_threads() const {
+	return compression_settings.threads;
+}
+
+void BytecodeCompiler::set_multithread_min_size(int64_t p_size) {
+	compression_settings.multithread_min_size = MAX(p_size, (int64_t)0);
+}
+
+int64_t BytecodeCompiler::get_multithread_min_size() const {
+	return compression_settings.multithread_min_size;
+}
+
+void BytecodeCompiler::set_reorder_tables(bool p_enabled) {
+	parse_options.reorder_tables = p_enabled;
+}
+
+bool BytecodeCompiler::is_reorder_tables() const {
+	return parse_options.reorder_tables;
+}
+
+void BytecodeCompiler::set_minify_locals(bool p_enabled) {
+	parse_options.minify_locals = p_enabled;
+}
+
+bool BytecodeCompiler::is_minify_locals() const {
+	return parse_options.minify_locals;
+}
+
+int64_t BytecodeCompiler::get_minified_bytes() const {
+	return minified_bytes;
+}
+
+void BytecodeCompiler::set_strip_debug(bool p_enabled) {
+	parse_options.strip_debug = p_enabled;
+}
+
+bool BytecodeCompiler::is_strip_debug() const {
+	return parse_options.strip_debug;
+}
+
+void BytecodeCompiler::set_stripped_calls(const PackedStringArray &p_calls) {
+	parse_options.stripped_calls.clear();
+	for (const String &name : p_calls) {
+		if (!name.is_empty()) {
+			parse_options.stripped_calls.push_back(name);
+		}
+	}
+}
+
+PackedStringArray BytecodeCompiler::get_stripped_calls() const {
+	PackedStringArray calls;
+	for (const StringName &name : parse_options.stripped_calls) {
+		calls.push_back(name);
+	}
+	return calls;
+}
+
+void BytecodeCompiler::set_features(const PackedStringArray &p_features) {
+	parse_options.features.clear();
+	for (const String &feature : p_features) {
+		if (!feature.is_empty()) {
+			parse_options.features.push_back(feature);
+		}
+	}
+}
+
+PackedStringArray BytecodeCompiler::get_features() const {
+	PackedStringArray features;
+	for (const StringName &feature : parse_options.features) {
+		features.push_back(feature);
+	}
+	return features;
+}
+
+void BytecodeCompiler::set_streaming_compression(bool p_enabled) {
+	compression_settings.streaming = p_enabled;
+}
+
+bool BytecodeCompiler::is_streaming_compression() const {
+	return compression_settings.streaming;
+}
+
+void BytecodeCompiler::set_deferred_compression(bool p_enabled) {
+	deferred_compression = p_enabled;
+}
+
+bool BytecodeCompiler::is_deferred_compression() const {
+	return deferred_compression;
+}
+
+void BytecodeCompiler::set_deterministic_check(bool p_enabled) {
+	deterministic_check = p_enabled;
+}
+
+bool BytecodeCompiler::is_deterministic_check() const {
+	return deterministic_check;
+}
+
+void BytecodeCompiler::set_auto_compression_min_size(int p_size) {
+	auto_compression_min_size = MAX(p_size, 0);
+}
+
+int BytecodeCompiler::get_auto_compression_min_size() const {
+	return auto_compression_min_size;
+}
+
+void BytecodeCompiler::set_auto_compression_max_ratio(float p_ratio) {
+	auto_compression_max_ratio = CLAMP(p_ratio, 0.0f, 1.0f);
+}
+
+float BytecodeCompiler::get_auto_compression_max_ratio() const {
+	return auto_compression_max_ratio;
+}
+
+void BytecodeCompiler::set_log_errors(bool p_enabled) {
+	log_errors = p_enabled;
+}
+
+bool BytecodeCompiler::is_log_errors() const {
+	return log_errors;
+}
+
+void BytecodeCompiler::_report(DiagnosticKind p_kind, const String &p_path, int32_t p_line, int32_t p_column,
+		const String &p_detail) {
+	String message;
+	{
+		MutexLock lock(*diagnostics_mutex.ptr());
+		int32_t file = -1;
+		if (!p_path.is_empty()) {
+			HashMap<String, int32_t>::Iterator E = diagnostic_file_indices.find(p_path);
+			if (E) {
+				file = E->value;
+			} else {
+				file = diagnostic_files.size();
+				diagnostic_file_indices.insert(p_path, file);
+				diagnostic_files.push_back(p_path);
+			}
+		}
+		diagnostics.push_back(Diagnostic{ p_kind, p_line, p_column, file, p_detail });
+		if (!log_errors) {
+			return; // Batch runs read the diagnostics instead, no message is ever built.
+		}
+		message = _format_diagnostic(diagnostics[diagnostics.size() - 1]);
+	}
+	UtilityFunctions::push_error(message);
+}
+
+String BytecodeCompiler::_format_diagnostic(const Diagnostic &p_diagnostic) const {
+	String message;
+	switch (p_diagnostic.kind) {
+		case DIAGNOSTIC_EMPTY_SOURCE:
+			message = "Source code can't be empty.";
+			break;
+		case DIAGNOSTIC_INVALID_SCRIPT:
+			message = "The provided script is not valid.";
+			break;
+		case DIAGNOSTIC_TOKENIZER_ERROR:
+			message = p_diagnostic.detail;
+			break;
+		case DIAGNOSTIC_NOT_DETERMINISTIC:
+			message = "Bytecode compilation is not deterministic.";
+			break;
+		case DIAGNOSTIC_COMPILATION_FAILED:
+			message = "Bytecode compilation failed.";
+			break;
+		case DIAGNOSTIC_CANT_OPEN_FILE:
+			message = "Can't open the file.";
+			break;
+		case DIAGNOSTIC_CANT_CREATE_DIRECTORY:
+			message = vformat("Can't create the directory \"%s\".", p_diagnostic.detail);
+			break;
+		case DIAGNOSTIC_CANT_WRITE_FILE:
+			message = vformat("Can't open the file \"%s\" for writing.", p_diagnostic.detail);
+			break;
+	}
+
+	// Same location format as the engine's script errors.
+	if (p_diagnostic.file >= 0 && p_diagnostic.line > 0) {
+		return vformat("%s:%d:%d - %s", diagnostic_files[p_diagnostic.file], p_diagnostic.line, p_diagnostic.column, message);
+	} else if (p_diagnostic.file >= 0) {
+		return vformat("%s - %s", diagnostic_files[p_diagnostic.file], message);
+	} else if (p_diagnostic.line > 0) {
+		return vformat("Line %d:%d - %s", p_diagnostic.line, p_diagnostic.column, message);
+	}
+	return message;
+}
+
+int BytecodeCompiler::get_diagnostic_count() {
+	MutexLock lock(*diagnostics_mutex.ptr());
+	return diagnostics.size();
+}
+
+PackedInt32Array BytecodeCompiler::get_diagnostics() {
+	MutexLock lock(*diagnostics_mutex.ptr());
+	PackedInt32Array result;
+	result.resize(diagnostics.size() * 4);
+	int32_t *w = result.ptrw();
+	for (const Diagnostic &diagnostic : diagnostics) {
+		*w++ = diagnostic.kind;
+		*w++ = diagnostic.line;
+		*w++ = diagnostic.column;
+		*w++ = diagnostic.file;
+	}
+	return result;
+}
+
+PackedStringArray BytecodeCompiler::get_diagnostic_files() {
+	MutexLock lock(*diagnostics_mutex.ptr());
+	return diagnostic_files;
+}
+
+String BytecodeCompiler::format_diagnostic(int p_index) {
+	MutexLock lock(*diagnostics_mutex.ptr());
+	ERR_FAIL_INDEX_V(p_index, (int)diagnostics.size(), String());
+	return _format_diagnostic(diagnostics[p_index]);
+}
+
+void BytecodeCompiler::clear_diagnostics() {
+	MutexLock lock(*diagnostics_mutex.ptr());
+	diagnostics.clear();
+	diagnostic_files.clear();
+	diagnostic_file_indices.clear();
+}
+
+PackedByteArray BytecodeCompiler::_compress_if_worth(const PackedByteArray &p_bytecode) {
+	// Small payloads don't shrink enough to pay for the decompression on load.
+	if (p_bytecode.size() - HEADER_SIZE < auto_compression_min_size) {
+		return p_bytecode;
+	}
+	PackedByteArray compressed = compress(p_bytecode);
+	if (compressed.is_empty() || compressed.size() > p_bytecode.size() * auto_compression_max_ratio) {
+		return p_bytecode;
+	}
+	return compressed;
+}
+
+Error BytecodeCompiler::_compile(const String &p_source_code, const String &p_path, CompressionMode p_compression,
+		bool p_allow_deferred, PackedByteArray &r_bytecode) {
 	// Validate if there is code.
-	PackedByteArray bytes;
-	if (source_code.is_empty()) {
-		UtilityFunctions::push_error(
-				"Source code can't be empty. The resulting PackedByteArray will be empty.");
-		return bytes;
+	if (p_source_code.is_empty()) {
+		_report(DIAGNOSTIC_EMPTY_SOURCE, p_path);
+		return ERR_INVALID_DATA;
 	}
 
 	// Parse the source code into binary tokens with the tokenizer.
-	auto compress_mode = compression == COMPRESSED ? GDScriptTokenizerBuffer::COMPRESS_ZSTD
-												   : GDScriptTokenizerBuffer::COMPRESS_NONE;
-	GDScriptTokenizerBuffer tokenizer;
-	bytes = tokenizer.parse_code_string(source_code, compress_mode);
+	// Deferred compression tokenizes uncompressed and leaves zstd to a worker.
+	bool deferred = p_compression == COMPRESSED && deferred_compression && p_allow_deferred;
+	auto compress_mode = p_compression == COMPRESSED && !deferred
+			? GDScriptTokenizerBuffer::COMPRESS_ZSTD
+			: GDScriptTokenizerBuffer::COMPRESS_NONE;
+	GDScriptTokenizerBuffer::ParseReport report;
+	PackedByteArray bytes = GDScriptTokenizerBuffer::parse_code_string(p_source_code, compress_mode, compression_settings, parse_options, &report);
+	minified_bytes = report.minified_bytes;
 
-	for (const auto &token : tokenizer.tokens) {
-		if (token.type == GDScriptTokenizer::Token::ERROR) {
-			// There was an error during tokenization, return an empty PackedByteArray.
-			UtilityFunctions::push_error(vformat(
-					"%s. The resulting PackedByteArray will be empty.", String(token.literal)));
-			return PackedByteArray();
+	if (!report.errors.is_empty()) {
+		// There were errors during tokenization, the engine would fail to parse the result.
+		for (const GDScriptTokenizer::Token &token : report.errors) {
+			_report(DIAGNOSTIC_TOKENIZER_ERROR, p_path, token.start_line, token.start_column, token.literal);
+		}
+		return ERR_PARSE_ERROR;
+	}
+
+	if (deterministic_check && !bytes.is_empty()) {
+		// Compile again from scratch, a cache keyed by the output can only trust identical bytes.
+		if (GDScriptTokenizerBuffer::parse_code_string(p_source_code, compress_mode, compression_settings, parse_options) != bytes) {
+			_report(DIAGNOSTIC_NOT_DETERMINISTIC, p_path);
+			return ERR_BUG;
 		}
 	}
 
 	if (bytes.is_empty()) {
 		// Something went wrong, return anyway.
-		UtilityFunctions::push_error(
-				"Bytecode compilation failed. The resulting PackedByteArray will be empty.");
+		_report(DIAGNOSTIC_COMPILATION_FAILED, p_path);
+		return FAILED;
+	} else if (p_compression == AUTO) {
+		bytes = _compress_if_worth(bytes);
+	} else if (deferred) {
+		_queue_deferred_compression(bytes);
 	}
+	r_bytecode = bytes;
+	return OK;
+}
+
+PackedByteArray BytecodeCompiler::compile_from_string(
+		const String &source_code, CompressionMode compression) {
+	PackedByteArray bytes;
+	_compile(source_code, String(), compression, true, bytes);
 	return bytes;
 }
 
 PackedByteArray BytecodeCompiler::compile_from_script(
 		const Script *source_script, CompressionMode compression) {
-	// No null allowed.
-	if (source_script == nullptr) {
-		UtilityFunctions::push_error(
-				"The script can't be null. The resulting PackedByteArray will be empty.");
+	// No null allowed, and if not a valid GDScript, reject as well.
+	if (source_script == nullptr || source_script->get_class() != String("GDScript") || !source_script->has_source_code()) {
+		_report(DIAGNOSTIC_INVALID_SCRIPT, source_script != nullptr ? source_script->get_path() : String());
 		return PackedByteArray();
 	}
 
-	// If not a valid GDScript, reject as well.
-	if (source_script->get_class() != String("GDScript") || !source_script->has_source_code()) {
-		UtilityFunctions::push_error(
-				"The provided script is not valid. The resulting PackedByteArray will be empty.");
-		return PackedByteArray();
+	// Otherwise compile the source code from the Script.
+	PackedByteArray bytes;
+	_compile(source_script->get_source_code(), source_script->get_path(), compression, true, bytes);
+	return bytes;
+}
+
+Error BytecodeCompiler::compile_file(const String &source_path, const String &target_path, CompressionMode compression) {
+	String source_code;
+	{
+		Ref<FileAccess> source_file = FileAccess::open(source_path, FileAccess::READ);
+		if (source_file.is_null()) {
+			_report(DIAGNOSTIC_CANT_OPEN_FILE, source_path);
+			return FileAccess::get_open_error();
+		}
+		source_code = source_file->get_as_text();
 	}
 
-	// Otherwise compile the source code from the Script.
-	return compile_from_string(source_script->get_source_code(), compression);
+	// The output is written right away, so it's never left for deferred compression.
+	PackedByteArray bytes;
+	Error err = _compile(source_code, source_path, compression, false, bytes);
+	if (err != OK) {
+		return err;
+	}
+
+	err = DirAccess::make_dir_recursive_absolute(target_path.get_base_dir());
+	if (err != OK) {
+		_report(DIAGNOSTIC_CANT_CREATE_DIRECTORY, source_path, 0, 0, target_path.get_base_dir());
+		return err;
+	}
+	Ref<FileAccess> target_file = FileAccess::open(target_path, FileAccess::WRITE);
+	if (target_file.is_null()) {
+		_report(DIAGNOSTIC_CANT_WRITE_FILE, source_path, 0, 0, target_path);
+		return FileAccess::get_open_error();
+	}
+	target_file->store_buffer(bytes);
+	err = target_file->get_error();
+	if (err != OK) {
+		_report(DIAGNOSTIC_CANT_WRITE_FILE, source_path, 0, 0, target_path);
+	}
+	return err;
 }
 
 PackedByteArray BytecodeCompiler::compress(const PackedByteArray bytecode) {
+	return _compress(bytecode, compression_settings);
+}
+
+PackedByteArray BytecodeCompiler::_compress(
+		const PackedByteArray &bytecode, const CompressionSettings &p_settings) {
 	PackedByteArray compressed_bytecode;
 	// Validate size of supposed uncompressed bytecode.
 	if (bytecode.size() < HEADER_SIZE) {
@@ -103,38 +508,364 @@ PackedByteArray BytecodeCompiler::compress(const PackedByteArray bytecode) {
 	}
 
 	// Validate if the header of the bytecode is valid.
-	if (bytecode.decode_u8(0) != 'G' || bytecode.decode_u8(1) != 'D' ||
-			bytecode.decode_u8(2) != 'S' || bytecode.decode_u8(3) != 'C') {
+	const uint8_t *r = bytecode.ptr();
+	if (r[0] != 'G' || r[1] != 'D' || r[2] != 'S' || r[3] != 'C') {
 		UtilityFunctions::push_error(
 				"The bytecode seems to be invalid. The resulting PackedByteArray will be empty.");
 		return compressed_bytecode;
 	}
-	if (bytecode.decode_u32(4) != TOKENIZER_VERSION) {
+	if (decode_uint32(r + 4) != TOKENIZER_VERSION) {
 		UtilityFunctions::push_error("The bytecode was generated with a different engine/extension "
 									 "version. The resulting PackedByteArray will be empty.");
 		return compressed_bytecode;
 	}
-	if (bytecode.decode_u32(8) > 0) {
+	if (decode_uint32(r + 8) > 0) {
 		UtilityFunctions::push_warning(
 				"The bytecode is already compressed. Returned the same bytecode.");
 		return bytecode;
 	}
 
-	// Split header and compress binary tokens.
-	PackedByteArray contents;
-	contents.resize(bytecode.size() - HEADER_SIZE);
-	auto content_size = contents.size();
-	memcpy(contents.ptrw(), bytecode.ptr() + HEADER_SIZE, content_size);
-	contents = contents.compress(FileAccess::COMPRESSION_ZSTD);
-
-	compressed_bytecode.resize(HEADER_SIZE);
-	compressed_bytecode.encode_u32(0, bytecode.decode_u32(0));
-	compressed_bytecode.encode_u32(4, bytecode.decode_u32(4));
-	compressed_bytecode.encode_u32(8, content_size);
-	compressed_bytecode.append_array(contents);
+	// Compress the binary tokens straight after a copy of the header, in a single buffer.
+	int64_t content_size = bytecode.size() - HEADER_SIZE;
+	int64_t max_size = Compression::get_max_compressed_size(content_size);
+	compressed_bytecode.resize(HEADER_SIZE + max_size);
+	uint8_t *w = compressed_bytecode.ptrw();
+	int64_t compressed_size = Compression::compress(
+			w + HEADER_SIZE, max_size, r + HEADER_SIZE, content_size, p_settings);
+	if (compressed_size < 0) {
+		UtilityFunctions::push_error(
+				"Bytecode compression failed. The resulting PackedByteArray will be empty.");
+		return PackedByteArray();
+	}
+	memcpy(w, r, 8);
+	encode_uint32(content_size, w + 8);
+	compressed_bytecode.resize(HEADER_SIZE + compressed_size);
 	return compressed_bytecode;
 }
 
-BytecodeCompiler::BytecodeCompiler() {}
+PackedByteArray BytecodeCompiler::decompress(const PackedByteArray bytecode) {
+	PackedByteArray decompressed_bytecode;
+	// Validate size of supposed compressed bytecode.
+	if (bytecode.size() < HEADER_SIZE) {
+		UtilityFunctions::push_error(
+				"The bytecode is too small. The resulting PackedByteArray will be empty.");
+		return decompressed_bytecode;
+	}
+
+	// Validate if the header of the bytecode is valid.
+	const uint8_t *r = bytecode.ptr();
+	if (r[0] != 'G' || r[1] != 'D' || r[2] != 'S' || r[3] != 'C') {
+		UtilityFunctions::push_error(
+				"The bytecode seems to be invalid. The resulting PackedByteArray will be empty.");
+		return decompressed_bytecode;
+	}
+	if (decode_uint32(r + 4) != TOKENIZER_VERSION) {
+		UtilityFunctions::push_error("The bytecode was generated with a different engine/extension "
+									 "version. The resulting PackedByteArray will be empty.");
+		return decompressed_bytecode;
+	}
+	uint32_t content_size = decode_uint32(r + 8);
+	if (content_size == 0) {
+		UtilityFunctions::push_warning(
+				"The bytecode is already uncompressed. Returned the same bytecode.");
+		return bytecode;
+	}
+
+	// The stored size is only trusted once the zstd frame declares the same, it decides the allocation.
+	if (Compression::get_decompressed_size(r + HEADER_SIZE, bytecode.size() - HEADER_SIZE) != content_size) {
+		UtilityFunctions::push_error(
+				"The compressed bytecode is corrupted. The resulting PackedByteArray will be empty.");
+		return decompressed_bytecode;
+	}
+
+	// Expand the binary tokens straight after a copy of the header, using the stored size.
+	decompressed_bytecode.resize(HEADER_SIZE + content_size);
+	uint8_t *w = decompressed_bytecode.ptrw();
+	int64_t decompressed_size = Compression::decompress(
+			w + HEADER_SIZE, content_size, r + HEADER_SIZE, bytecode.size() - HEADER_SIZE);
+	if (decompressed_size != content_size) {
+		UtilityFunctions::push_error(
+				"The compressed bytecode is corrupted. The resulting PackedByteArray will be empty.");
+		return PackedByteArray();
+	}
+	memcpy(w, r, 8);
+	encode_uint32(0, w + 8);
+	return decompressed_bytecode;
+}
+
+Error BytecodeCompiler::decompress_directory(const String &source_dir, const String &target_dir) {
+	Ref<DirAccess> dir = DirAccess::open(source_dir);
+	if (dir.is_null()) {
+		UtilityFunctions::push_error(vformat("Can't open the directory \"%s\".", source_dir));
+		return DirAccess::get_open_error();
+	}
+	String target = target_dir.is_empty() ? source_dir : target_dir;
+	Error err = DirAccess::make_dir_recursive_absolute(target);
+	if (err != OK) {
+		UtilityFunctions::push_error(vformat("Can't create the directory \"%s\".", target));
+		return err;
+	}
+
+	// A file that fails is reported and skipped, so one bad file doesn't leave the rest unconverted.
+	Error first_error = OK;
+	for (const String &file : dir->get_files()) {
+		if (file.get_extension() != "gdc") {
+			continue;
+		}
+		String source_path = source_dir.path_join(file);
+		String target_path = target.path_join(file);
+		PackedByteArray bytecode = FileAccess::get_file_as_bytes(source_path);
+		const uint8_t *r = bytecode.ptr();
+		if (bytecode.size() < HEADER_SIZE || r[0] != 'G' || r[1] != 'D' || r[2] != 'S' || r[3] != 'C' ||
+				decode_uint32(r + 4) != TOKENIZER_VERSION) {
+			UtilityFunctions::push_error(vformat("Can't read valid bytecode from \"%s\", skipped.", source_path));
+			first_error = first_error == OK ? ERR_FILE_CORRUPT : first_error;
+			continue;
+		}
+		if (decode_uint32(r + 8) == 0) {
+			// Already uncompressed, only copy it over when writing somewhere else.
+			if (target_path == source_path) {
+				continue;
+			}
+		} else {
+			bytecode = decompress(bytecode);
+			if (bytecode.is_empty()) {
+				first_error = first_error == OK ? ERR_FILE_CORRUPT : first_error;
+				continue;
+			}
+		}
+		Ref<FileAccess> out = FileAccess::open(target_path, FileAccess::WRITE);
+		if (out.is_null()) {
+			UtilityFunctions::push_error(vformat("Can't write the file \"%s\", skipped.", target_path));
+			first_error = first_error == OK ? FileAccess::get_open_error() : first_error;
+			continue;
+		}
+		out->store_buffer(bytecode);
+	}
+
+	for (const String &subdir : dir->get_directories()) {
+		err = decompress_directory(source_dir.path_join(subdir), target.path_join(subdir));
+		first_error = first_error == OK ? err : first_error;
+	}
+	return first_error;
+}
+
+PackedByteArray BytecodeCompiler::make_patch(const PackedByteArray old_bytecode, const PackedByteArray new_bytecode) {
+	PackedByteArray patch;
+	Error err = BytecodePatch::make(old_bytecode, new_bytecode, compression_settings, patch);
+	if (err != OK) {
+		UtilityFunctions::push_error(vformat(
+				"Can't make a patch between the bytecodes (%s). The resulting PackedByteArray will be empty.", UtilityFunctions::error_string(err)));
+		return PackedByteArray();
+	}
+	return patch;
+}
+
+PackedByteArray BytecodeCompiler::apply_patch(const PackedByteArray old_bytecode, const PackedByteArray patch) {
+	PackedByteArray new_bytecode;
+	Error err = BytecodePatch::apply(old_bytecode, patch, compression_settings, new_bytecode);
+	if (err == ERR_INVALID_PARAMETER) {
+		UtilityFunctions::push_error(
+				"The patch was made for a different bytecode. The resulting PackedByteArray will be empty.");
+		return PackedByteArray();
+	} else if (err != OK) {
+		UtilityFunctions::push_error(vformat(
+				"Can't apply the patch (%s). The resulting PackedByteArray will be empty.", UtilityFunctions::error_string(err)));
+		return PackedByteArray();
+	}
+	return new_bytecode;
+}
+
+Error BytecodeCompiler::verify(const PackedByteArray bytecode) {
+	// Loads the bytecode the same way the engine does, which validates every section on the way.
+	GDScriptTokenizerBuffer tokenizer;
+	Error err = tokenizer.set_code_buffer(bytecode);
+	if (err != OK) {
+		return err;
+	}
+	for (const GDScriptTokenizer::Token &token : tokenizer.tokens) {
+		if (token.type == GDScriptTokenizer::Token::ERROR) {
+			return ERR_PARSE_ERROR;
+		}
+	}
+	return OK;
+}
+
+BytecodeCompiler::BytecodeSection BytecodeCompiler::compare(
+		const PackedByteArray bytecode, const PackedByteArray other_bytecode) {
+	// Sections are compared as encoded, nothing is decoded into Variants.
+	PackedByteArray storage[2];
+	const uint8_t *contents[2];
+	uint32_t sizes[2];
+	uint32_t offsets[2][GDScriptTokenizerBuffer::SECTION_MAX + 1];
+	const PackedByteArray *inputs[2] = { &bytecode, &other_bytecode };
+	for (int i = 0; i < 2; i++) {
+		if (GDScriptTokenizerBuffer::read_contents(*inputs[i], storage[i], contents[i], sizes[i]) != OK ||
+				GDScriptTokenizerBuffer::get_section_offsets(contents[i], sizes[i], offsets[i]) != OK) {
+			return SECTION_INVALID;
+		}
+	}
+
+	// Whether the contents are compressed doesn't matter, only the version does.
+	if (decode_uint32(bytecode.ptr() + 4) != decode_uint32(other_bytecode.ptr() + 4)) {
+		return SECTION_HEADER;
+	}
+
+	// Counts of each section, the word at offset 12 is unused and left out.
+	static const int count_offsets[GDScriptTokenizerBuffer::SECTION_MAX] = { 0, 4, 8, 8, 16 };
+	for (int section = 0; section < GDScriptTokenizerBuffer::SECTION_MAX; section++) {
+		uint32_t start = offsets[0][section];
+		uint32_t size = offsets[0][section + 1] - start;
+		uint32_t other_start = offsets[1][section];
+		if (decode_uint32(contents[0] + count_offsets[section]) != decode_uint32(contents[1] + count_offsets[section]) ||
+				size != offsets[1][section + 1] - other_start ||
+				memcmp(contents[0] + start, contents[1] + other_start, size) != 0) {
+			return BytecodeSection(SECTION_IDENTIFIERS + section);
+		}
+	}
+	return SECTION_NONE;
+}
+
+static PackedInt32Array _to_packed(const LocalVector<int32_t> &p_values) {
+	PackedInt32Array packed;
+	packed.resize(p_values.size());
+	if (p_values.size() > 0) {
+		memcpy(packed.ptrw(), p_values.ptr(), p_values.size() * sizeof(int32_t));
+	}
+	return packed;
+}
+
+Dictionary BytecodeCompiler::tokenize(const String &source_code) const {
+	// The raw scanner tokens, before any transform, one entry per token in each column-wise array.
+	GDScriptTokenizerText tokenizer;
+	tokenizer.set_source_code(source_code);
+	tokenizer.set_multiline_mode(true);
+
+	LocalVector<int32_t> types;
+	LocalVector<int32_t> start_lines;
+	LocalVector<int32_t> end_lines;
+	LocalVector<int32_t> start_columns;
+	LocalVector<int32_t> end_columns;
+	LocalVector<int32_t> values;
+	HashMap<StringName, int32_t> identifier_map;
+	PackedStringArray identifiers;
+	GDScriptTokenizerBuffer::ConstantPool constants;
 
-BytecodeCompiler::~BytecodeCompiler() {}
+	for (GDScriptTokenizer::Token token = tokenizer.scan(); token.type != GDScriptTokenizer::Token::TK_EOF; token = tokenizer.scan()) {
+		int32_t value = -1;
+		switch (token.type) {
+			case GDScriptTokenizer::Token::IDENTIFIER:
+			case GDScriptTokenizer::Token::ANNOTATION: {
+				StringName identifier = token.get_identifier();
+				HashMap<StringName, int32_t>::Iterator E = identifier_map.find(identifier);
+				if (E) {
+					value = E->value;
+				} else {
+					value = identifiers.size();
+					identifier_map.insert(identifier, value);
+					identifiers.push_back(identifier);
+				}
+			} break;
+			case GDScriptTokenizer::Token::LITERAL:
+			case GDScriptTokenizer::Token::ERROR: {
+				value = constants.add(token.literal);
+			} break;
+			default:
+				break;
+		}
+		types.push_back(token.type);
+		start_lines.push_back(token.start_line);
+		end_lines.push_back(token.end_line);
+		start_columns.push_back(token.start_column);
+		end_columns.push_back(token.end_column);
+		values.push_back(value);
+	}
+
+	Array constant_values;
+	constant_values.resize(constants.values.size());
+	for (uint32_t i = 0; i < constants.values.size(); i++) {
+		constant_values[i] = constants.values[i];
+	}
+
+	Dictionary result;
+	result["types"] = _to_packed(types);
+	result["start_lines"] = _to_packed(start_lines);
+	result["end_lines"] = _to_packed(end_lines);
+	result["start_columns"] = _to_packed(start_columns);
+	result["end_columns"] = _to_packed(end_columns);
+	result["values"] = _to_packed(values);
+	result["identifiers"] = identifiers;
+	result["constants"] = constant_values;
+	return result;
+}
+
+String BytecodeCompiler::get_token_name(int type) const {
+	ERR_FAIL_INDEX_V(type, GDScriptTokenizer::Token::TK_MAX, String());
+	return GDScriptTokenizer::get_token_name(GDScriptTokenizer::Token::Type(type));
+}
+
+TypedArray<PackedByteArray> BytecodeCompiler::compress_batch(const TypedArray<PackedByteArray> &bytecodes) {
+	TypedArray<PackedByteArray> compressed_bytecodes;
+	compressed_bytecodes.resize(bytecodes.size());
+	for (int64_t i = 0; i < bytecodes.size(); i++) {
+		compressed_bytecodes[i] = compress(bytecodes[i]);
+	}
+	return compressed_bytecodes;
+}
+
+void BytecodeCompiler::_queue_deferred_compression(const PackedByteArray &p_bytecode) {
+	MutexLock lock(*deferred_mutex.ptr());
+	uint64_t job = deferred_job_counter++;
+	// The settings are copied so later changes don't affect compressions already queued.
+	deferred_jobs[job] = DeferredCompression{ compression_settings, -1 };
+	deferred_jobs[job].task_id = WorkerThreadPool::get_singleton()->add_task(
+			callable_mp(this, &BytecodeCompiler::_deferred_compression_task).bind(p_bytecode, job),
+			false, "Compress bytecode");
+}
+
+void BytecodeCompiler::_deferred_compression_task(const PackedByteArray &p_bytecode, uint64_t p_job) {
+	CompressionSettings settings;
+	{
+		MutexLock lock(*deferred_mutex.ptr());
+		settings = deferred_jobs[p_job].settings;
+	}
+	PackedByteArray compressed = _compress(p_bytecode, settings);
+	callable_mp(this, &BytecodeCompiler::_finish_deferred_compression).call_deferred(p_bytecode, compressed, p_job);
+}
+
+void BytecodeCompiler::_finish_deferred_compression(
+		const PackedByteArray &p_bytecode, const PackedByteArray &p_compressed, uint64_t p_job) {
+	int64_t task_id;
+	{
+		MutexLock lock(*deferred_mutex.ptr());
+		task_id = deferred_jobs[p_job].task_id;
+		deferred_jobs.erase(p_job);
+	}
+	// Already done at this point, but every pool task has to be waited on once.
+	WorkerThreadPool::get_singleton()->wait_for_task_completion(task_id);
+	emit_signal("compression_finished", p_bytecode, p_compressed);
+}
+
+int BytecodeCompiler::get_pending_compressions() {
+	MutexLock lock(*deferred_mutex.ptr());
+	return deferred_jobs.size();
+}
+
+BytecodeCompiler::BytecodeCompiler() {
+	deferred_mutex.instantiate();
+	diagnostics_mutex.instantiate();
+}
+
+BytecodeCompiler::~BytecodeCompiler() {
+	// Tasks hold a pointer to this compiler, let them finish before it goes away.
+	LocalVector<int64_t> task_ids;
+	{
+		MutexLock lock(*deferred_mutex.ptr());
+		for (const KeyValue<uint64_t, DeferredCompression> &E : deferred_jobs) {
+			task_ids.push_back(E.value.task_id);
+		}
+	}
+	for (int64_t task_id : task_ids) {
+		WorkerThreadPool::get_singleton()->wait_for_task_completion(task_id);
+	}
+}
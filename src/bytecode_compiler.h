@@ -23,27 +23,156 @@
 #ifndef BYTECODE_COMPILER_H
 #define BYTECODE_COMPILER_H
 
+#include "compression.h"
+#include "gdscript/gdscript_tokenizer_buffer.h"
+#include <godot_cpp/classes/mutex.hpp>
 #include <godot_cpp/classes/ref_counted.hpp>
 #include <godot_cpp/classes/script.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
 #include <godot_cpp/variant/string.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/typed_array.hpp>
+#include <atomic>
 
 namespace godot {
 
+// Compilation, compression, verification and patching keep their state on the stack of the
+// call, so one instance can serve several threads at once. Properties are plain fields read
+// by every call: set them before sharing the instance, not while it compiles.
 class BytecodeCompiler : public RefCounted {
 	GDCLASS(BytecodeCompiler, RefCounted)
 
+public:
+	enum CompressionMode { UNCOMPRESSED, COMPRESSED, AUTO };
+	enum BytecodeSection {
+		SECTION_NONE,
+		SECTION_HEADER,
+		SECTION_IDENTIFIERS,
+		SECTION_CONSTANTS,
+		SECTION_LINES,
+		SECTION_COLUMNS,
+		SECTION_TOKENS,
+		SECTION_INVALID,
+	};
+	enum DiagnosticKind {
+		DIAGNOSTIC_EMPTY_SOURCE,
+		DIAGNOSTIC_INVALID_SCRIPT,
+		DIAGNOSTIC_TOKENIZER_ERROR,
+		DIAGNOSTIC_NOT_DETERMINISTIC,
+		DIAGNOSTIC_COMPILATION_FAILED,
+		DIAGNOSTIC_CANT_OPEN_FILE,
+		DIAGNOSTIC_CANT_CREATE_DIRECTORY,
+		DIAGNOSTIC_CANT_WRITE_FILE,
+	};
+
+private:
+	struct DeferredCompression {
+		CompressionSettings settings;
+		int64_t task_id = -1;
+	};
+
+	// Nothing is formatted when a diagnostic is recorded, the detail is a string that already
+	// existed, such as the tokenizer's message or a path.
+	struct Diagnostic {
+		DiagnosticKind kind;
+		int32_t line; // 0 when not about a place in the source.
+		int32_t column;
+		int32_t file; // Index in diagnostic_files, -1 for sources without a path.
+		String detail;
+	};
+
+	CompressionSettings compression_settings;
+	GDScriptTokenizerBuffer::ParseOptions parse_options;
+	int auto_compression_min_size = 1024;
+	float auto_compression_max_ratio = 0.9;
+	bool deferred_compression = false;
+	bool deterministic_check = false;
+	bool log_errors = true;
+	std::atomic<uint32_t> minified_bytes = { 0 }; // Of the compilation that finished last.
+
+	Ref<Mutex> deferred_mutex;
+	HashMap<uint64_t, DeferredCompression> deferred_jobs;
+	uint64_t deferred_job_counter = 0;
+
+	Ref<Mutex> diagnostics_mutex;
+	LocalVector<Diagnostic> diagnostics;
+	PackedStringArray diagnostic_files;
+	HashMap<String, int32_t> diagnostic_file_indices;
+
+	Error _compile(const String &p_source_code, const String &p_path, CompressionMode p_compression,
+			bool p_allow_deferred, PackedByteArray &r_bytecode);
+	void _report(DiagnosticKind p_kind, const String &p_path, int32_t p_line = 0, int32_t p_column = 0,
+			const String &p_detail = String());
+	String _format_diagnostic(const Diagnostic &p_diagnostic) const;
+	static PackedByteArray _compress(const PackedByteArray &bytecode, const CompressionSettings &p_settings);
+	PackedByteArray _compress_if_worth(const PackedByteArray &p_bytecode);
+	void _queue_deferred_compression(const PackedByteArray &p_bytecode);
+	void _deferred_compression_task(const PackedByteArray &p_bytecode, uint64_t p_job);
+	void _finish_deferred_compression(const PackedByteArray &p_bytecode, const PackedByteArray &p_compressed, uint64_t p_job);
+
 protected:
 	static void _bind_methods();
 
 public:
-	enum CompressionMode { UNCOMPRESSED, COMPRESSED };
+	void set_compression_level(int p_level);
+	int get_compression_level() const;
+	void set_long_distance_matching(bool p_enabled);
+	bool is_long_distance_matching() const;
+	void set_compression_threads(int p_threads);
+	int get_compression_threads() const;
+	void set_multithread_min_size(int64_t p_size);
+	int64_t get_multithread_min_size() const;
+	void set_reorder_tables(bool p_enabled);
+	bool is_reorder_tables() const;
+	void set_minify_locals(bool p_enabled);
+	bool is_minify_locals() const;
+	int64_t get_minified_bytes() const;
+	void set_strip_debug(bool p_enabled);
+	bool is_strip_debug() const;
+	void set_stripped_calls(const PackedStringArray &p_calls);
+	PackedStringArray get_stripped_calls() const;
+	void set_features(const PackedStringArray &p_features);
+	PackedStringArray get_features() const;
+	void set_streaming_compression(bool p_enabled);
+	bool is_streaming_compression() const;
+	void set_deferred_compression(bool p_enabled);
+	bool is_deferred_compression() const;
+	int get_pending_compressions();
+	void set_deterministic_check(bool p_enabled);
+	bool is_deterministic_check() const;
+	void set_auto_compression_min_size(int p_size);
+	int get_auto_compression_min_size() const;
+	void set_auto_compression_max_ratio(float p_ratio);
+	float get_auto_compression_max_ratio() const;
+	void set_log_errors(bool p_enabled);
+	bool is_log_errors() const;
+
+	int get_diagnostic_count();
+	PackedInt32Array get_diagnostics();
+	PackedStringArray get_diagnostic_files();
+	String format_diagnostic(int p_index);
+	void clear_diagnostics();
 
 	PackedByteArray compile_from_string(
 			const String &source_code, CompressionMode compression = UNCOMPRESSED);
 	PackedByteArray compile_from_script(
 			const Script *source_script, CompressionMode compression = UNCOMPRESSED);
+	Error compile_file(const String &source_path, const String &target_path, CompressionMode compression = UNCOMPRESSED);
 	PackedByteArray compress(const PackedByteArray bytecode);
+	TypedArray<PackedByteArray> compress_batch(const TypedArray<PackedByteArray> &bytecodes);
+	PackedByteArray decompress(const PackedByteArray bytecode);
+	Error decompress_directory(const String &source_dir, const String &target_dir = String());
+	PackedByteArray make_patch(const PackedByteArray old_bytecode, const PackedByteArray new_bytecode);
+	PackedByteArray apply_patch(const PackedByteArray old_bytecode, const PackedByteArray patch);
+	Error verify(const PackedByteArray bytecode);
+	BytecodeSection compare(const PackedByteArray bytecode, const PackedByteArray other_bytecode);
+	Dictionary tokenize(const String &source_code) const;
+	String get_token_name(int type) const;
 	BytecodeCompiler();
 	~BytecodeCompiler();
 };
@@ -51,5 +180,7 @@ public:
 } //namespace godot
 
 VARIANT_ENUM_CAST(BytecodeCompiler::CompressionMode);
+VARIANT_ENUM_CAST(BytecodeCompiler::BytecodeSection);
+VARIANT_ENUM_CAST(BytecodeCompiler::DiagnosticKind);
 
 #endif // BYTECODE_COMPILER_H
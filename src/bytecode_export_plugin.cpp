@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef TOOLS_ENABLED
+
+#include "bytecode_export_plugin.h"
+#include "gdscript/marshalls.h"
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/project_settings.hpp>
+#include <godot_cpp/classes/script.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+using namespace godot;
+
+void BytecodeExportPlugin::_bind_methods() {
+}
+
+String BytecodeExportPlugin::_get_name() const {
+	return "BytecodeCompiler";
+}
+
+TypedArray<Dictionary> BytecodeExportPlugin::_get_export_options(const Ref<EditorExportPlatform> &p_platform) const {
+	Dictionary property;
+	property["name"] = "bytecode_compiler/script_export_mode";
+	property["type"] = Variant::INT;
+	property["hint"] = PROPERTY_HINT_ENUM;
+	property["hint_string"] = "Engine,Binary tokens (faster loading),Compressed binary tokens (smaller files)";
+
+	Dictionary option;
+	option["option"] = property;
+	option["default_value"] = SCRIPT_EXPORT_MODE_ENGINE;
+
+	TypedArray<Dictionary> options;
+	options.push_back(option);
+	return options;
+}
+
+void BytecodeExportPlugin::_find_scripts(const String &p_dir, LocalVector<String> &r_paths) {
+	Ref<DirAccess> dir = DirAccess::open(p_dir);
+	if (dir.is_null() || dir->file_exists(".gdignore")) {
+		return;
+	}
+	for (const String &file : dir->get_files()) {
+		if (file.get_extension() == "gd") {
+			r_paths.push_back(p_dir.path_join(file));
+		}
+	}
+	for (const String &subdir : dir->get_directories()) {
+		if (!subdir.begins_with(".")) {
+			_find_scripts(p_dir.path_join(subdir), r_paths);
+		}
+	}
+}
+
+String BytecodeExportPlugin::get_cache_path(const String &p_source_code, GDScriptTokenizerBuffer::CompressMode p_compress_mode,
+		const CompressionSettings &p_settings, const PackedStringArray &p_features) {
+	// Compilation is deterministic, the same source and settings always give the same bytes.
+	String key = vformat("%d:%d:%d:%d:%d:%s\n", BYTECODE_EXPORT_CACHE_VERSION, TOKENIZER_VERSION, p_compress_mode,
+			p_settings.level, p_settings.long_distance_matching,
+			p_source_code.contains("@if_feature") ? String(",").join(p_features) : String());
+	return String(BYTECODE_EXPORT_CACHE_DIR).path_join((key + p_source_code).sha256_text() + ".gdc");
+}
+
+void BytecodeExportPlugin::store_cache(const String &p_cache_path, const PackedByteArray &p_bytecode, const String &p_writer) {
+	// Written aside and moved in place, so a reader never sees a partial entry.
+	String temp_path = p_cache_path + "." + p_writer + ".tmp";
+	Ref<FileAccess> file = FileAccess::open(temp_path, FileAccess::WRITE);
+	if (file.is_valid()) {
+		file->store_buffer(p_bytecode);
+		file->close();
+		DirAccess::rename_absolute(temp_path, p_cache_path);
+	}
+}
+
+CompressionSettings BytecodeExportPlugin::get_project_compression_settings() {
+	ProjectSettings *project_settings = ProjectSettings::get_singleton();
+	CompressionSettings settings;
+	settings.level = project_settings->get_setting("compression/formats/zstd/compression_level", ZSTD_DEFAULT_LEVEL);
+	settings.long_distance_matching = project_settings->get_setting("compression/formats/zstd/long_distance_matching", false);
+	return settings;
+}
+
+bool BytecodeExportPlugin::_is_valid_cache(const PackedByteArray &p_bytecode) const {
+	// Same checks as BytecodeCompiler::verify() up to the tokens, plus the header this export expects.
+	PackedByteArray storage;
+	const uint8_t *contents;
+	uint32_t size;
+	uint32_t offsets[GDScriptTokenizerBuffer::SECTION_MAX + 1];
+	if (GDScriptTokenizerBuffer::read_contents(p_bytecode, storage, contents, size) != OK ||
+			GDScriptTokenizerBuffer::get_section_offsets(contents, size, offsets) != OK) {
+		return false;
+	}
+	bool compressed = decode_uint32(p_bytecode.ptr() + 8) > 0;
+	return decode_uint32(p_bytecode.ptr() + 4) == TOKENIZER_VERSION &&
+			compressed == (compress_mode == GDScriptTokenizerBuffer::COMPRESS_ZSTD);
+}
+
+PackedByteArray BytecodeExportPlugin::_compile_script(const String &p_path, uint32_t p_task, String &r_cache_path, String &r_other_cache_path) const {
+	String source_code = FileAccess::get_file_as_string(p_path);
+	if (source_code.is_empty()) {
+		return PackedByteArray();
+	}
+
+	r_cache_path = get_cache_path(source_code, compress_mode, compression_settings, features);
+	GDScriptTokenizerBuffer::CompressMode other_mode = compress_mode == GDScriptTokenizerBuffer::COMPRESS_ZSTD ? GDScriptTokenizerBuffer::COMPRESS_NONE : GDScriptTokenizerBuffer::COMPRESS_ZSTD;
+	r_other_cache_path = get_cache_path(source_code, other_mode, compression_settings, features);
+	if (FileAccess::file_exists(r_cache_path)) {
+		PackedByteArray cached = FileAccess::get_file_as_bytes(r_cache_path);
+		if (_is_valid_cache(cached)) {
+			return cached;
+		}
+		// Damaged, compiled again and replaced below.
+	}
+
+	PackedByteArray bytecode = GDScriptTokenizerBuffer::parse_code_string(source_code, compress_mode, compression_settings, parse_options);
+	if (!bytecode.is_empty()) {
+		store_cache(r_cache_path, bytecode, itos(p_task));
+	}
+	return bytecode;
+}
+
+void BytecodeExportPlugin::_compile_task(uint32_t p_index) {
+	compiled_scripts[p_index] = _compile_script(script_paths[p_index], p_index, cache_paths[p_index], other_cache_paths[p_index]);
+}
+
+void BytecodeExportPlugin::_prune_cache() {
+	// Entries of older sources, settings or extension versions would otherwise pile up forever.
+	// What the current sources produce in either mode is kept, whichever mode this export used,
+	// as presets and saves alternate between them. Other entries are only removed once old enough.
+	HashSet<String> used;
+	for (const String &cache_path : cache_paths) {
+		used.insert(cache_path.get_file());
+	}
+	for (const String &cache_path : other_cache_paths) {
+		used.insert(cache_path.get_file());
+	}
+	for (const String &cache_path : extra_cache_paths) {
+		used.insert(cache_path.get_file());
+	}
+	Ref<DirAccess> dir = DirAccess::open(BYTECODE_EXPORT_CACHE_DIR);
+	if (dir.is_null()) {
+		return;
+	}
+	uint64_t oldest = (uint64_t)Time::get_singleton()->get_unix_time_from_system() - BYTECODE_EXPORT_CACHE_MAX_AGE_DAYS * 86400;
+	for (const String &file : dir->get_files()) {
+		// Temporary files may belong to a write in progress, they are moved in place or replaced.
+		if (file.get_extension() != "gdc" || used.has(file)) {
+			continue;
+		}
+		String path = String(BYTECODE_EXPORT_CACHE_DIR).path_join(file);
+		if (FileAccess::get_modified_time(path) < oldest) {
+			DirAccess::remove_absolute(path);
+		}
+	}
+}
+
+void BytecodeExportPlugin::_export_begin(const PackedStringArray &p_features, bool p_is_debug, const String &p_path, uint32_t p_flags) {
+	int mode = get_option("bytecode_compiler/script_export_mode");
+	exporting = mode != SCRIPT_EXPORT_MODE_ENGINE;
+	if (!exporting) {
+		return;
+	}
+
+	// Same settings as the engine's export, so the output is the same as well.
+	compress_mode = mode == SCRIPT_EXPORT_MODE_COMPRESSED_BINARY_TOKENS ? GDScriptTokenizerBuffer::COMPRESS_ZSTD : GDScriptTokenizerBuffer::COMPRESS_NONE;
+	compression_settings = get_project_compression_settings();
+
+	// The export features, such as the platform or "release", decide the @if_feature blocks.
+	features = p_features;
+	parse_options = GDScriptTokenizerBuffer::ParseOptions();
+	for (const String &feature : p_features) {
+		parse_options.features.push_back(feature);
+	}
+	DirAccess::make_dir_recursive_absolute(BYTECODE_EXPORT_CACHE_DIR);
+
+	// Compile every script of the project now, in parallel, _export_file() then only picks the results.
+	uint64_t time = Time::get_singleton()->get_ticks_msec();
+	script_paths.clear();
+	_find_scripts("res://", script_paths);
+	compiled_scripts.clear();
+	compiled_scripts.resize(script_paths.size());
+	cache_paths.clear();
+	cache_paths.resize(script_paths.size());
+	other_cache_paths.clear();
+	other_cache_paths.resize(script_paths.size());
+	extra_cache_paths.clear();
+	script_indices.clear();
+	for (uint32_t i = 0; i < script_paths.size(); i++) {
+		script_indices.insert(script_paths[i], i);
+	}
+	if (!script_paths.is_empty()) {
+		WorkerThreadPool *pool = WorkerThreadPool::get_singleton();
+		int64_t group = pool->add_group_task(callable_mp(this, &BytecodeExportPlugin::_compile_task),
+				script_paths.size(), -1, true, "Compile scripts to bytecode");
+		pool->wait_for_group_task_completion(group);
+	}
+	UtilityFunctions::print_verbose(vformat("BytecodeCompiler: compiled %d scripts in %d ms.", script_paths.size(),
+			Time::get_singleton()->get_ticks_msec() - time));
+}
+
+void BytecodeExportPlugin::_export_file(const String &p_path, const String &p_type, const PackedStringArray &p_features) {
+	if (!exporting || p_path.get_extension() != "gd") {
+		return;
+	}
+	HashMap<String, uint32_t>::ConstIterator index = script_indices.find(p_path);
+	PackedByteArray bytecode;
+	if (index) {
+		bytecode = compiled_scripts[index->value];
+	} else {
+		String cache_path;
+		String other_cache_path;
+		bytecode = _compile_script(p_path, 0, cache_path, other_cache_path);
+		extra_cache_paths.insert(cache_path);
+		extra_cache_paths.insert(other_cache_path);
+	}
+	if (bytecode.is_empty()) {
+		return; // Exported as text, the engine reports what's wrong with it.
+	}
+	// Remapped like the engine does, the .gd is replaced by the .gdc.
+	add_file(p_path.get_basename() + ".gdc", bytecode, true);
+}
+
+void BytecodeExportPlugin::_export_end() {
+	if (exporting) {
+		_prune_cache();
+	}
+	exporting = false;
+	script_paths.clear();
+	compiled_scripts.clear();
+	cache_paths.clear();
+	other_cache_paths.clear();
+	extra_cache_paths.clear();
+	script_indices.clear();
+}
+
+void BytecodeEditorPlugin::_bind_methods() {
+}
+
+void BytecodeEditorPlugin::_resource_saved(const Ref<Resource> &p_resource) {
+	Ref<Script> script = p_resource;
+	if (script.is_null() || script->get_class() != "GDScript" || script->get_path().get_extension() != "gd") {
+		return; // Built-in scripts have their scene's path.
+	}
+	save_compiler->queue(script->get_path(), script->get_source_code(), BytecodeExportPlugin::get_project_compression_settings());
+}
+
+void BytecodeEditorPlugin::_enter_tree() {
+	export_plugin.instantiate();
+	add_export_plugin(export_plugin);
+
+	status_label = memnew(Label);
+	status_label->set_tooltip_text("Saved scripts waiting to be compiled into the export cache.");
+	status_label->hide();
+	add_control_to_container(CONTAINER_TOOLBAR, status_label);
+	shown_queue_depth = -1;
+
+	if (save_compiler.is_null()) {
+		save_compiler.instantiate();
+	}
+	save_compiler->start();
+	connect("resource_saved", callable_mp(this, &BytecodeEditorPlugin::_resource_saved));
+	set_process(true);
+}
+
+void BytecodeEditorPlugin::_exit_tree() {
+	set_process(false);
+	disconnect("resource_saved", callable_mp(this, &BytecodeEditorPlugin::_resource_saved));
+	save_compiler->stop();
+
+	remove_control_from_container(CONTAINER_TOOLBAR, status_label);
+	memdelete(status_label);
+	status_label = nullptr;
+
+	remove_export_plugin(export_plugin);
+	export_plugin.unref();
+}
+
+void BytecodeEditorPlugin::_process(double p_delta) {
+	save_compiler->poll();
+	int queue_depth = save_compiler->get_queue_depth();
+	if (queue_depth == shown_queue_depth) {
+		return;
+	}
+	shown_queue_depth = queue_depth;
+	status_label->set_text(vformat("Compiling scripts: %d", queue_depth));
+	status_label->set_visible(queue_depth > 0);
+}
+
+#endif // TOOLS_ENABLED
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BYTECODE_EXPORT_PLUGIN_H
+#define BYTECODE_EXPORT_PLUGIN_H
+
+#ifdef TOOLS_ENABLED
+
+#include "bytecode_save_compiler.h"
+#include "compression.h"
+#include "gdscript/gdscript_tokenizer_buffer.h"
+#include <godot_cpp/classes/editor_export_plugin.hpp>
+#include <godot_cpp/classes/editor_plugin.hpp>
+#include <godot_cpp/classes/label.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/hash_set.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#define BYTECODE_EXPORT_CACHE_DIR "res://.godot/bytecode_cache"
+// Part of every cache key. Bump it whenever the encoder's output changes for the same source and
+// settings, so entries written by an older version of the extension are never used again.
+#define BYTECODE_EXPORT_CACHE_VERSION 1
+// Entries no current source produces for the export's features are kept this long after they
+// were written, so presets with other features don't remove each other's @if_feature scripts.
+#define BYTECODE_EXPORT_CACHE_MAX_AGE_DAYS 7
+
+namespace godot {
+
+// Converts the exported scripts to binary tokens instead of the engine, compiling every script
+// of the project at once on the worker thread pool when the export begins, and reusing the
+// results of earlier exports from a cache keyed by a hash of the source and settings.
+// The engine's own conversion runs first when the preset's script export mode isn't text, so
+// that's what the preset must use for scripts to reach this plugin.
+class BytecodeExportPlugin : public EditorExportPlugin {
+	GDCLASS(BytecodeExportPlugin, EditorExportPlugin)
+
+public:
+	enum ScriptExportMode {
+		SCRIPT_EXPORT_MODE_ENGINE, // Left to the engine.
+		SCRIPT_EXPORT_MODE_BINARY_TOKENS,
+		SCRIPT_EXPORT_MODE_COMPRESSED_BINARY_TOKENS,
+	};
+
+private:
+	GDScriptTokenizerBuffer::CompressMode compress_mode = GDScriptTokenizerBuffer::COMPRESS_NONE;
+	CompressionSettings compression_settings;
+	GDScriptTokenizerBuffer::ParseOptions parse_options;
+	PackedStringArray features;
+	bool exporting = false;
+
+	// Filled before the group task starts, each task only writes its own result.
+	LocalVector<String> script_paths;
+	LocalVector<PackedByteArray> compiled_scripts;
+	LocalVector<String> cache_paths;
+	LocalVector<String> other_cache_paths; // Of the other compression mode, kept by _prune_cache().
+	HashMap<String, uint32_t> script_indices;
+	HashSet<String> extra_cache_paths; // Of scripts compiled by _export_file(), outside the group task.
+
+	static void _find_scripts(const String &p_dir, LocalVector<String> &r_paths);
+	bool _is_valid_cache(const PackedByteArray &p_bytecode) const;
+	void _prune_cache();
+	PackedByteArray _compile_script(const String &p_path, uint32_t p_task, String &r_cache_path, String &r_other_cache_path) const;
+	void _compile_task(uint32_t p_index);
+
+protected:
+	static void _bind_methods();
+
+public:
+	// Cache file of a script compiled with these settings. Features only matter to scripts with
+	// @if_feature annotations, the rest share their entries between presets and compile on save.
+	static String get_cache_path(const String &p_source_code, GDScriptTokenizerBuffer::CompressMode p_compress_mode,
+			const CompressionSettings &p_settings, const PackedStringArray &p_features);
+	// Entries may be written from several threads at once, p_writer keeps their temporary files apart.
+	static void store_cache(const String &p_cache_path, const PackedByteArray &p_bytecode, const String &p_writer);
+	// The zstd settings the engine's export uses. Main thread only.
+	static CompressionSettings get_project_compression_settings();
+
+	virtual String _get_name() const override;
+	virtual TypedArray<Dictionary> _get_export_options(const Ref<EditorExportPlatform> &p_platform) const override;
+	virtual void _export_begin(const PackedStringArray &p_features, bool p_is_debug, const String &p_path, uint32_t p_flags) override;
+	virtual void _export_file(const String &p_path, const String &p_type, const PackedStringArray &p_features) override;
+	virtual void _export_end() override;
+};
+
+// Registers the export plugin and fills its cache as scripts are saved, showing the number of
+// scripts waiting to be compiled in the editor's toolbar.
+class BytecodeEditorPlugin : public EditorPlugin {
+	GDCLASS(BytecodeEditorPlugin, EditorPlugin)
+
+	Ref<BytecodeExportPlugin> export_plugin;
+	Ref<BytecodeSaveCompiler> save_compiler; // Kept until the plugin is freed, which joins its thread.
+	Label *status_label = nullptr;
+	int shown_queue_depth = -1;
+
+	void _resource_saved(const Ref<Resource> &p_resource);
+
+protected:
+	static void _bind_methods();
+
+public:
+	virtual void _enter_tree() override;
+	virtual void _exit_tree() override;
+	virtual void _process(double p_delta) override;
+};
+
+} //namespace godot
+
+#endif // TOOLS_ENABLED
+
+#endif // BYTECODE_EXPORT_PLUGIN_H
@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "bytecode_patch.h"
+#include "gdscript/gdscript_tokenizer_buffer.h"
+#include "gdscript/marshalls.h"
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/hashfuncs.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+using namespace godot;
+
+// The patch starts with "GDCP", PATCH_VERSION and the size of the payload, which follows zstd compressed:
+//   old contents size and hash, new contents size and hash, flags
+//   the 20 bytes of counts that start the new contents
+//   per section: the number of operations, then for each of them the count, size and bytes of
+//   new entries to insert, followed by the first index and count of old entries to copy
+#define PATCH_HEADER_SIZE 12
+#define PATCH_FLAG_COMPRESSED 1
+#define PATCH_UNMAPPED UINT32_MAX
+// Largest payload and new contents accepted, far above any script. Both sizes come from the patch,
+// so they are checked before anything is allocated for them.
+#define PATCH_MAX_SIZE (64 * 1024 * 1024)
+
+namespace {
+
+typedef GDScriptTokenizerBuffer Buffer;
+
+// Uncompressed contents of a bytecode, with the start of every entry of each section.
+struct BytecodeEntries {
+	PackedByteArray storage;
+	const uint8_t *data = nullptr;
+	uint32_t size = 0;
+	uint32_t offsets[Buffer::SECTION_MAX + 1];
+	LocalVector<uint32_t> entries[Buffer::SECTION_MAX]; // Plus the end of the section.
+
+	Error load(const PackedByteArray &p_bytecode) {
+		Error err = Buffer::read_contents(p_bytecode, storage, data, size);
+		if (err != OK) {
+			return err;
+		}
+		err = Buffer::get_section_offsets(data, size, offsets);
+		if (err != OK) {
+			return err;
+		}
+		// Already validated, so entries are found without further checks.
+		for (int section = 0; section < Buffer::SECTION_MAX; section++) {
+			uint32_t pos = offsets[section];
+			uint32_t end = offsets[section + 1];
+			while (pos < end) {
+				entries[section].push_back(pos);
+				switch (section) {
+					case Buffer::SECTION_IDENTIFIERS:
+						pos += (decode_uint32(data + pos) + 1) * 4;
+						break;
+					case Buffer::SECTION_CONSTANTS:
+						pos += Buffer::_decode_constant(data + pos, end - pos, nullptr);
+						break;
+					case Buffer::SECTION_TOKENS:
+						pos += (data[pos] & Buffer::TOKEN_BYTE_MASK) ? 8 : 5;
+						break;
+					default:
+						pos += 8;
+						break;
+				}
+			}
+			entries[section].push_back(end);
+		}
+		return OK;
+	}
+
+	uint32_t count(int p_section) const { return entries[p_section].size() - 1; }
+};
+
+// Entries of a section in a form where an edit only changes the entries it touches. Token indices,
+// lines and columns are stored relative to the previous entry, and token references to the
+// identifier and constant tables use the indices of the new tables.
+struct NormalizedSection {
+	LocalVector<uint8_t> data;
+	LocalVector<uint32_t> starts; // Plus the end of the data.
+	LocalVector<uint32_t> hashes;
+
+	uint32_t count() const { return starts.size() - 1; }
+	bool equals(uint32_t p_index, const NormalizedSection &p_other, uint32_t p_other_index) const {
+		uint32_t size = starts[p_index + 1] - starts[p_index];
+		return hashes[p_index] == p_other.hashes[p_other_index] &&
+				size == p_other.starts[p_other_index + 1] - p_other.starts[p_other_index] &&
+				memcmp(data.ptr() + starts[p_index], p_other.data.ptr() + p_other.starts[p_other_index], size) == 0;
+	}
+};
+
+struct PatchWriter {
+	LocalVector<uint8_t> data;
+
+	void put_u32(uint32_t p_value) {
+		uint32_t pos = data.size();
+		data.resize(pos + 4);
+		encode_uint32(p_value, data.ptr() + pos);
+	}
+	void put_bytes(const uint8_t *p_bytes, uint32_t p_size) {
+		uint32_t pos = data.size();
+		data.resize(pos + p_size);
+		memcpy(data.ptr() + pos, p_bytes, p_size);
+	}
+};
+
+struct PatchReader {
+	const uint8_t *data = nullptr;
+	uint32_t size = 0;
+	uint32_t pos = 0;
+	bool failed = false;
+
+	uint32_t get_u32() {
+		if (failed || pos + 4 > size) {
+			failed = true;
+			return 0;
+		}
+		pos += 4;
+		return decode_uint32(data + pos - 4);
+	}
+	const uint8_t *get_bytes(uint32_t p_size) {
+		if (failed || uint64_t(pos) + p_size > size) {
+			failed = true;
+			return nullptr;
+		}
+		pos += p_size;
+		return data + pos - p_size;
+	}
+};
+
+} // namespace
+
+// p_maps translate old identifier and constant indices into new ones, null when normalizing the new bytecode.
+static void _normalize_section(int p_section, const BytecodeEntries &p_entries, const LocalVector<uint32_t> *p_maps, NormalizedSection &r_section) {
+	const uint8_t *data = p_entries.data;
+	const LocalVector<uint32_t> &entries = p_entries.entries[p_section];
+	uint32_t count = p_entries.count(p_section);
+	r_section.starts.resize(count + 1);
+	r_section.hashes.resize(count);
+
+	if (p_section == Buffer::SECTION_IDENTIFIERS || p_section == Buffer::SECTION_CONSTANTS) {
+		// Stored as is, entries in these tables are unique and don't depend on each other.
+		uint32_t start = entries[0];
+		r_section.data.resize(entries[count] - start);
+		memcpy(r_section.data.ptr(), data + start, r_section.data.size());
+		for (uint32_t i = 0; i <= count; i++) {
+			r_section.starts[i] = entries[i] - start;
+		}
+	} else {
+		r_section.data.resize(count * 8);
+		uint32_t previous[2] = { 0, 0 };
+		for (uint32_t i = 0; i < count; i++) {
+			const uint8_t *entry = data + entries[i];
+			uint8_t *w = r_section.data.ptr() + i * 8;
+			r_section.starts[i] = i * 8;
+			if (p_section == Buffer::SECTION_TOKENS) {
+				// Type word as stored, which keeps the long form flag, followed by the line difference.
+				bool long_form = entry[0] & Buffer::TOKEN_BYTE_MASK;
+				uint32_t word = long_form ? decode_uint32(entry) : entry[0];
+				uint32_t line = decode_uint32(entry + (long_form ? 4 : 1));
+				if (p_maps && long_form) {
+					int table = -1;
+					switch (word & Buffer::TOKEN_MASK) {
+						case GDScriptTokenizer::Token::ANNOTATION:
+						case GDScriptTokenizer::Token::IDENTIFIER:
+							table = Buffer::SECTION_IDENTIFIERS;
+							break;
+						case GDScriptTokenizer::Token::ERROR:
+						case GDScriptTokenizer::Token::LITERAL:
+							table = Buffer::SECTION_CONSTANTS;
+							break;
+						default:
+							break;
+					}
+					if (table >= 0) {
+						uint32_t index = p_maps[table][word >> Buffer::TOKEN_BITS];
+						// Not in the new table, an invalid type word makes sure it never matches.
+						word = index == PATCH_UNMAPPED ? UINT32_MAX : (word & 0xFF) | (index << Buffer::TOKEN_BITS);
+					}
+				}
+				encode_uint32(word, w);
+				encode_uint32(line - previous[0], w + 4);
+				previous[0] = line;
+			} else {
+				// Token index difference, followed by the line difference or the column.
+				uint32_t token_index = decode_uint32(entry);
+				uint32_t value = decode_uint32(entry + 4);
+				encode_uint32(token_index - previous[0], w);
+				encode_uint32(p_section == Buffer::SECTION_LINES ? value - previous[1] : value, w + 4);
+				previous[0] = token_index;
+				previous[1] = value;
+			}
+		}
+		r_section.starts[count] = count * 8;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		r_section.hashes[i] = hash_murmur3_buffer(r_section.data.ptr() + r_section.starts[i], r_section.starts[i + 1] - r_section.starts[i]);
+	}
+}
+
+// Inverse of _normalize_section() for the new bytecode, appends the section to r_contents.
+static void _denormalize_section(int p_section, const uint8_t *p_data, uint32_t p_size, LocalVector<uint8_t> &r_contents) {
+	uint32_t pos = r_contents.size();
+	if (p_section == Buffer::SECTION_IDENTIFIERS || p_section == Buffer::SECTION_CONSTANTS) {
+		r_contents.resize(pos + p_size);
+		memcpy(r_contents.ptr() + pos, p_data, p_size);
+		return;
+	}
+
+	uint32_t previous[2] = { 0, 0 };
+	r_contents.resize(pos + p_size);
+	for (uint32_t i = 0; i + 8 <= p_size; i += 8) {
+		uint32_t first = decode_uint32(p_data + i);
+		uint32_t second = decode_uint32(p_data + i + 4);
+		uint8_t *w = r_contents.ptr() + pos;
+		if (p_section == Buffer::SECTION_TOKENS) {
+			previous[0] += second;
+			if (first & Buffer::TOKEN_BYTE_MASK) {
+				encode_uint32(first, w);
+				encode_uint32(previous[0], w + 4);
+				pos += 8;
+			} else {
+				*w = first;
+				encode_uint32(previous[0], w + 1);
+				pos += 5;
+			}
+		} else {
+			previous[0] += first;
+			previous[1] = p_section == Buffer::SECTION_LINES ? previous[1] + second : second;
+			encode_uint32(previous[0], w);
+			encode_uint32(previous[1], w + 4);
+			pos += 8;
+		}
+	}
+	r_contents.resize(pos);
+}
+
+// Records where each old table entry ended up, following the copy operations of the section.
+static void _map_copy(LocalVector<uint32_t> &r_map, uint32_t p_old_start, uint32_t p_count, uint32_t p_new_start) {
+	for (uint32_t i = 0; i < p_count; i++) {
+		r_map[p_old_start + i] = p_new_start + i;
+	}
+}
+
+Error BytecodePatch::make(const PackedByteArray &p_old_bytecode, const PackedByteArray &p_new_bytecode,
+		const CompressionSettings &p_settings, PackedByteArray &r_patch) {
+	BytecodeEntries old_entries;
+	BytecodeEntries new_entries;
+	Error err = old_entries.load(p_old_bytecode);
+	if (err != OK) {
+		return err;
+	}
+	err = new_entries.load(p_new_bytecode);
+	if (err != OK) {
+		return err;
+	}
+
+	PatchWriter writer;
+	writer.put_u32(old_entries.size);
+	writer.put_u32(hash_murmur3_buffer(old_entries.data, old_entries.size));
+	writer.put_u32(new_entries.size);
+	writer.put_u32(hash_murmur3_buffer(new_entries.data, new_entries.size));
+	writer.put_u32(decode_uint32(p_new_bytecode.ptr() + 8) > 0 ? PATCH_FLAG_COMPRESSED : 0);
+	writer.put_bytes(new_entries.data, 20);
+
+	// Sections are diffed in order, so the tables are mapped by the time tokens refer to them.
+	LocalVector<uint32_t> maps[2];
+	for (int section = 0; section < Buffer::SECTION_MAX; section++) {
+		NormalizedSection old_section;
+		NormalizedSection new_section;
+		_normalize_section(section, old_entries, maps, old_section);
+		_normalize_section(section, new_entries, nullptr, new_section);
+		uint32_t old_count = old_section.count();
+		uint32_t new_count = new_section.count();
+		if (section <= Buffer::SECTION_CONSTANTS) {
+			maps[section].resize(old_count);
+			for (uint32_t i = 0; i < old_count; i++) {
+				maps[section][i] = PATCH_UNMAPPED;
+			}
+		}
+
+		// Index the old entries by runs, table entries are unique so single ones are enough.
+		uint32_t run = section <= Buffer::SECTION_CONSTANTS ? 1 : 4;
+		HashMap<uint32_t, uint32_t> old_runs;
+		for (uint32_t i = 0; i + run <= old_count; i++) {
+			uint32_t hash = hash_murmur3_buffer(old_section.hashes.ptr() + i, run * sizeof(uint32_t));
+			if (!old_runs.has(hash)) {
+				old_runs.insert(hash, i);
+			}
+		}
+
+		// Greedily copy from the old entries, everything that can't be found is inserted.
+		LocalVector<uint32_t> operations; // Insert start, insert count, copy start, copy count.
+		uint32_t insert_start = 0;
+		uint32_t new_pos = 0;
+		uint32_t old_next = 0; // Right after the last old entry copied or replaced.
+		while (new_pos < new_count) {
+			// Keep following the old entries in order, runs are only looked up when that stops matching.
+			uint32_t copy_start = old_next;
+			if (copy_start >= old_count || !old_section.equals(copy_start, new_section, new_pos)) {
+				const uint32_t *found = nullptr;
+				if (new_pos + run <= new_count) {
+					found = old_runs.getptr(hash_murmur3_buffer(new_section.hashes.ptr() + new_pos, run * sizeof(uint32_t)));
+				}
+				copy_start = found ? *found : old_count;
+			}
+			uint32_t copy_count = 0;
+			while (copy_start + copy_count < old_count && new_pos + copy_count < new_count &&
+					old_section.equals(copy_start + copy_count, new_section, new_pos + copy_count)) {
+				copy_count++;
+			}
+			if (copy_count == 0) {
+				// Either inserted or replacing the old entry at this point.
+				new_pos++;
+				old_next++;
+				continue;
+			}
+			operations.push_back(insert_start);
+			operations.push_back(new_pos - insert_start);
+			operations.push_back(copy_start);
+			operations.push_back(copy_count);
+			if (section <= Buffer::SECTION_CONSTANTS) {
+				_map_copy(maps[section], copy_start, copy_count, new_pos);
+			}
+			new_pos += copy_count;
+			old_next = copy_start + copy_count;
+			insert_start = new_pos;
+		}
+		if (insert_start < new_count || operations.is_empty()) {
+			operations.push_back(insert_start);
+			operations.push_back(new_count - insert_start);
+			operations.push_back(0);
+			operations.push_back(0);
+		}
+
+		writer.put_u32(operations.size() / 4);
+		for (uint32_t i = 0; i < operations.size(); i += 4) {
+			uint32_t start = new_section.starts[operations[i]];
+			uint32_t size = new_section.starts[operations[i] + operations[i + 1]] - start;
+			writer.put_u32(operations[i + 1]);
+			writer.put_u32(size);
+			writer.put_bytes(new_section.data.ptr() + start, size);
+			writer.put_u32(operations[i + 2]);
+			writer.put_u32(operations[i + 3]);
+		}
+	}
+
+	int64_t max_size = Compression::get_max_compressed_size(writer.data.size());
+	r_patch.resize(PATCH_HEADER_SIZE + max_size);
+	uint8_t *w = r_patch.ptrw();
+	int64_t compressed_size = Compression::compress(w + PATCH_HEADER_SIZE, max_size, writer.data.ptr(), writer.data.size(), p_settings);
+	if (compressed_size < 0) {
+		r_patch.clear();
+		return ERR_BUG;
+	}
+	w[0] = 'G';
+	w[1] = 'D';
+	w[2] = 'C';
+	w[3] = 'P';
+	encode_uint32(PATCH_VERSION, w + 4);
+	encode_uint32(writer.data.size(), w + 8);
+	r_patch.resize(PATCH_HEADER_SIZE + compressed_size);
+	return OK;
+}
+
+Error BytecodePatch::apply(const PackedByteArray &p_old_bytecode, const PackedByteArray &p_patch,
+		const CompressionSettings &p_settings, PackedByteArray &r_new_bytecode) {
+	const uint8_t *p = p_patch.ptr();
+	if (p_patch.size() < PATCH_HEADER_SIZE || p[0] != 'G' || p[1] != 'D' || p[2] != 'C' || p[3] != 'P' ||
+			decode_uint32(p + 4) != PATCH_VERSION) {
+		return ERR_INVALID_DATA;
+	}
+	uint32_t payload_size = decode_uint32(p + 8);
+	if (payload_size > PATCH_MAX_SIZE ||
+			Compression::get_decompressed_size(p + PATCH_HEADER_SIZE, p_patch.size() - PATCH_HEADER_SIZE) != payload_size) {
+		return ERR_FILE_CORRUPT;
+	}
+	LocalVector<uint8_t> payload;
+	payload.resize(payload_size);
+	if (Compression::decompress(payload.ptr(), payload.size(), p + PATCH_HEADER_SIZE, p_patch.size() - PATCH_HEADER_SIZE) != payload.size()) {
+		return ERR_FILE_CORRUPT;
+	}
+
+	BytecodeEntries old_entries;
+	Error err = old_entries.load(p_old_bytecode);
+	if (err != OK) {
+		return err;
+	}
+
+	PatchReader reader;
+	reader.data = payload.ptr();
+	reader.size = payload.size();
+	uint32_t old_size = reader.get_u32();
+	uint32_t old_hash = reader.get_u32();
+	if (old_size != old_entries.size || old_hash != hash_murmur3_buffer(old_entries.data, old_entries.size)) {
+		return ERR_INVALID_PARAMETER; // Made against another bytecode.
+	}
+	uint32_t new_size = reader.get_u32();
+	uint32_t new_hash = reader.get_u32();
+	uint32_t flags = reader.get_u32();
+	const uint8_t *counts = reader.get_bytes(20);
+	if (reader.failed || new_size > PATCH_MAX_SIZE) {
+		return ERR_FILE_CORRUPT;
+	}
+
+	LocalVector<uint8_t> contents;
+	contents.reserve(new_size);
+	contents.resize(20);
+	memcpy(contents.ptr(), counts, 20);
+
+	LocalVector<uint32_t> maps[2];
+	for (int section = 0; section < Buffer::SECTION_MAX; section++) {
+		NormalizedSection old_section;
+		_normalize_section(section, old_entries, maps, old_section);
+		uint32_t old_count = old_section.count();
+		if (section <= Buffer::SECTION_CONSTANTS) {
+			maps[section].resize(old_count);
+			for (uint32_t i = 0; i < old_count; i++) {
+				maps[section][i] = PATCH_UNMAPPED;
+			}
+		}
+
+		LocalVector<uint8_t> new_section;
+		uint32_t new_count = 0;
+		uint32_t operation_count = reader.get_u32();
+		for (uint32_t i = 0; i < operation_count && !reader.failed; i++) {
+			uint32_t insert_count = reader.get_u32();
+			uint32_t insert_size = reader.get_u32();
+			const uint8_t *insert = reader.get_bytes(insert_size);
+			uint32_t copy_start = reader.get_u32();
+			uint32_t copy_count = reader.get_u32();
+			if (reader.failed || uint64_t(copy_start) + copy_count > old_count) {
+				return ERR_FILE_CORRUPT;
+			}
+			new_count += insert_count;
+			if (section <= Buffer::SECTION_CONSTANTS) {
+				_map_copy(maps[section], copy_start, copy_count, new_count);
+			}
+			new_count += copy_count;
+
+			uint32_t copy_offset = old_section.starts[copy_start];
+			uint32_t copy_size = old_section.starts[copy_start + copy_count] - copy_offset;
+			uint32_t pos = new_section.size();
+			// Copies can repeat old entries, so the declared size bounds them. Normalized tokens take up
+			// to 8 bytes instead of 5, twice the size leaves room for that.
+			if (uint64_t(contents.size()) + pos + insert_size + copy_size > uint64_t(new_size) * 2) {
+				return ERR_FILE_CORRUPT;
+			}
+			new_section.resize(pos + insert_size + copy_size);
+			memcpy(new_section.ptr() + pos, insert, insert_size);
+			memcpy(new_section.ptr() + pos + insert_size, old_section.data.ptr() + copy_offset, copy_size);
+		}
+		if (reader.failed) {
+			return ERR_FILE_CORRUPT;
+		}
+		_denormalize_section(section, new_section.ptr(), new_section.size(), contents);
+	}
+
+	// The result has to be exactly what the patch was made from.
+	if (contents.size() != new_size || hash_murmur3_buffer(contents.ptr(), contents.size()) != new_hash) {
+		return ERR_FILE_CORRUPT;
+	}
+
+	if (flags & PATCH_FLAG_COMPRESSED) {
+		int64_t max_size = Compression::get_max_compressed_size(new_size);
+		r_new_bytecode.resize(HEADER_SIZE + max_size);
+		int64_t compressed_size = Compression::compress(r_new_bytecode.ptrw() + HEADER_SIZE, max_size, contents.ptr(), new_size, p_settings);
+		if (compressed_size < 0) {
+			r_new_bytecode.clear();
+			return ERR_BUG;
+		}
+		r_new_bytecode.resize(HEADER_SIZE + compressed_size);
+	} else {
+		r_new_bytecode.resize(HEADER_SIZE + new_size);
+		memcpy(r_new_bytecode.ptrw() + HEADER_SIZE, contents.ptr(), new_size);
+	}
+	uint8_t *header = r_new_bytecode.ptrw();
+	header[0] = 'G';
+	header[1] = 'D';
+	header[2] = 'S';
+	header[3] = 'C';
+	encode_uint32(TOKENIZER_VERSION, header + 4);
+	encode_uint32(flags & PATCH_FLAG_COMPRESSED ? new_size : 0u, header + 8);
+	return OK;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef BYTECODE_PATCH_H
+#define BYTECODE_PATCH_H
+
+#include "compression.h"
+#include <godot_cpp/variant/packed_byte_array.hpp>
+
+#define PATCH_VERSION 1
+
+namespace godot {
+
+// Delta between two bytecodes that understands the tokenizer buffer sections.
+// Each section is diffed by entries: identifiers and constants by value, and the line,
+// column and token tables allowing for the shift in token indices, lines and table
+// indices that an edit causes in everything after it. The new entries are matched greedily
+// against runs of old ones found by hash, and stored as operations that insert new entries
+// followed by a copy of old ones. The whole patch is compressed.
+class BytecodePatch {
+public:
+	static Error make(const PackedByteArray &p_old_bytecode, const PackedByteArray &p_new_bytecode,
+			const CompressionSettings &p_settings, PackedByteArray &r_patch);
+	// A compressed result is compressed with p_settings, so it's only byte exact when they match the ones
+	// the new bytecode was compiled with.
+	static Error apply(const PackedByteArray &p_old_bytecode, const PackedByteArray &p_patch,
+			const CompressionSettings &p_settings, PackedByteArray &r_new_bytecode);
+};
+
+} //namespace godot
+
+#endif // BYTECODE_PATCH_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef TOOLS_ENABLED
+
+#include "bytecode_save_compiler.h"
+#include "bytecode_export_plugin.h"
+#include "gdscript/gdscript_tokenizer_buffer.h"
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+using namespace godot;
+
+void BytecodeSaveCompiler::_bind_methods() {
+}
+
+void BytecodeSaveCompiler::_finish() {
+	// Waits for at most the mode being compiled when stop() was called.
+	if (thread->is_started()) {
+		thread->wait_to_finish();
+	}
+}
+
+void BytecodeSaveCompiler::start() {
+	if (running) {
+		return;
+	}
+	_finish();
+	running = true;
+	thread->start(callable_mp(this, &BytecodeSaveCompiler::_run));
+}
+
+void BytecodeSaveCompiler::stop() {
+	if (!running) {
+		return;
+	}
+	{
+		MutexLock lock(*mutex.ptr());
+		running = false;
+		jobs.clear();
+	}
+	semaphore->post();
+	pending.clear();
+	queue_depth = 0;
+}
+
+void BytecodeSaveCompiler::queue(const String &p_path, const String &p_source_code, const CompressionSettings &p_settings) {
+	// Scripts with feature directives depend on the export preset, they are left to the export.
+	if (!running || p_source_code.contains("@if_feature")) {
+		return;
+	}
+	Job job;
+	job.source_code = p_source_code;
+	job.settings = p_settings;
+	job.due_msec = Time::get_singleton()->get_ticks_msec() + SAVE_COMPILE_DEBOUNCE_MSEC;
+	{
+		MutexLock lock(*mutex.ptr());
+		// Makes the job of an older save stale, even while it is being compiled.
+		job.generation = ++generations[p_path];
+	}
+	pending[p_path] = job;
+}
+
+void BytecodeSaveCompiler::poll() {
+	if (!running) {
+		return;
+	}
+	uint64_t now = Time::get_singleton()->get_ticks_msec();
+	LocalVector<String> due;
+	for (const KeyValue<String, Job> &E : pending) {
+		if (E.value.due_msec <= now) {
+			due.push_back(E.key);
+		}
+	}
+
+	MutexLock lock(*mutex.ptr());
+	for (const String &path : due) {
+		jobs[path] = pending[path];
+		pending.erase(path);
+		semaphore->post();
+	}
+	queue_depth = pending.size() + jobs.size() + compiling;
+}
+
+void BytecodeSaveCompiler::_run() {
+	static const GDScriptTokenizerBuffer::CompressMode modes[] = {
+		GDScriptTokenizerBuffer::COMPRESS_NONE,
+		GDScriptTokenizerBuffer::COMPRESS_ZSTD,
+	};
+
+	DirAccess::make_dir_recursive_absolute(BYTECODE_EXPORT_CACHE_DIR);
+	while (true) {
+		semaphore->wait();
+		String path;
+		Job job;
+		{
+			MutexLock lock(*mutex.ptr());
+			if (!running) {
+				return;
+			}
+			if (jobs.is_empty()) {
+				continue; // A newer save replaced a job, its post is left over.
+			}
+			path = jobs.begin()->key;
+			job = jobs.begin()->value;
+			jobs.erase(path);
+			compiling = 1;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			String cache_path = BytecodeExportPlugin::get_cache_path(job.source_code, modes[i], job.settings, PackedStringArray());
+			bool cached = FileAccess::file_exists(cache_path);
+			PackedByteArray bytecode;
+			if (!cached) {
+				bytecode = GDScriptTokenizerBuffer::parse_code_string(job.source_code, modes[i], job.settings);
+			}
+
+			String previous;
+			{
+				MutexLock lock(*mutex.ptr());
+				if (!running || generations[path] != job.generation) {
+					break; // Stale, a newer save of the script is queued.
+				}
+				if (!cached && bytecode.is_empty()) {
+					break;
+				}
+				if (cache_paths[i].has(path)) {
+					previous = cache_paths[i][path];
+				}
+				cache_paths[i][path] = cache_path;
+			}
+			if (!cached) {
+				BytecodeExportPlugin::store_cache(cache_path, bytecode, "save");
+			}
+			if (!previous.is_empty() && previous != cache_path) {
+				DirAccess::remove_absolute(previous);
+			}
+		}
+
+		MutexLock lock(*mutex.ptr());
+		compiling = 0;
+	}
+}
+
+BytecodeSaveCompiler::BytecodeSaveCompiler() {
+	thread.instantiate();
+	mutex.instantiate();
+	semaphore.instantiate();
+}
+
+BytecodeSaveCompiler::~BytecodeSaveCompiler() {
+	stop();
+	_finish();
+}
+
+#endif // TOOLS_ENABLED
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BYTECODE_SAVE_COMPILER_H
+#define BYTECODE_SAVE_COMPILER_H
+
+#ifdef TOOLS_ENABLED
+
+#include "compression.h"
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/classes/semaphore.hpp>
+#include <godot_cpp/classes/thread.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#define SAVE_COMPILE_DEBOUNCE_MSEC 500
+
+namespace godot {
+
+// Compiles saved scripts on a background thread into the export cache, uncompressed and
+// compressed, so exports find them already compiled. A save only queues the source: the
+// job waits on the main thread for SAVE_COMPILE_DEBOUNCE_MSEC without another save of the
+// same script, which replaces it. A newer save makes a job stale, it is checked before each
+// mode is written. Each script keeps one cache entry per mode, the previous one is removed.
+class BytecodeSaveCompiler : public RefCounted {
+	GDCLASS(BytecodeSaveCompiler, RefCounted)
+
+	struct Job {
+		String source_code;
+		CompressionSettings settings;
+		uint64_t generation = 0;
+		uint64_t due_msec = 0;
+	};
+
+	Ref<Thread> thread;
+	Ref<Mutex> mutex;
+	Ref<Semaphore> semaphore;
+	HashMap<String, Job> jobs; // Handed to the worker, by script path.
+	HashMap<String, uint64_t> generations; // Of the latest save, by script path.
+	HashMap<String, String> cache_paths[2]; // Last written, by mode and script path.
+	int compiling = 0;
+	bool running = false;
+
+	HashMap<String, Job> pending; // Main thread only, until their debounce ends.
+	int queue_depth = 0;
+
+	void _run();
+	void _finish();
+
+protected:
+	static void _bind_methods();
+
+public:
+	void start();
+	// Only cancels, the worker finishes its current mode on its own and is joined by the next
+	// start() or the destructor, so the editor never waits for a compilation.
+	void stop();
+	// Never blocks on compilation, only takes the queue lock.
+	void queue(const String &p_path, const String &p_source_code, const CompressionSettings &p_settings);
+	void poll(); // Hands the jobs whose debounce ended to the worker, from the main thread.
+	int get_queue_depth() const { return queue_depth; } // Pending, queued and in progress.
+
+	BytecodeSaveCompiler();
+	~BytecodeSaveCompiler();
+};
+
+} //namespace godot
+
+#endif // TOOLS_ENABLED
+
+#endif // BYTECODE_SAVE_COMPILER_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "compression.h"
+#include <godot_cpp/core/defs.hpp>
+#include <zstd.h>
+
+using namespace godot;
+
+namespace {
+
+// Building a zstd context allocates and initializes its tables, which dominates the cost of
+// compressing small scripts. Each thread keeps its own context alive and resets it per call.
+struct ThreadCompressionContext {
+	ZSTD_CCtx *cctx = nullptr;
+	ZSTD_DCtx *dctx = nullptr;
+
+	~ThreadCompressionContext() {
+		ZSTD_freeCCtx(cctx);
+		ZSTD_freeDCtx(dctx);
+	}
+};
+
+thread_local ThreadCompressionContext thread_context;
+
+} // namespace
+
+ZSTD_CCtx *Compression::_get_thread_cctx() {
+	if (thread_context.cctx == nullptr) {
+		thread_context.cctx = ZSTD_createCCtx();
+	}
+	return thread_context.cctx;
+}
+
+ZSTD_DCtx *Compression::_get_thread_dctx() {
+	if (thread_context.dctx == nullptr) {
+		thread_context.dctx = ZSTD_createDCtx();
+	}
+	return thread_context.dctx;
+}
+
+int64_t Compression::get_max_compressed_size(int64_t p_src_size) {
+	return ZSTD_compressBound(p_src_size);
+}
+
+void Compression::_setup_cctx(ZSTD_CCtx *p_cctx, int64_t p_src_size, const CompressionSettings &p_settings) {
+	ZSTD_CCtx_reset(p_cctx, ZSTD_reset_session_and_parameters);
+	ZSTD_CCtx_setParameter(p_cctx, ZSTD_c_compressionLevel, p_settings.level);
+	if (p_settings.long_distance_matching) {
+		// The engine only accepts windows up to 2^27 unless its own long distance matching setting is on.
+		ZSTD_CCtx_setParameter(p_cctx, ZSTD_c_enableLongDistanceMatching, 1);
+		ZSTD_CCtx_setParameter(p_cctx, ZSTD_c_windowLog, ZSTD_WINDOW_LOG_MAX);
+	}
+	if (p_settings.threads > 0 && p_src_size >= p_settings.multithread_min_size) {
+		// Still a single standard frame. Fails harmlessly if zstd was built without ZSTD_MULTITHREAD.
+		ZSTD_CCtx_setParameter(p_cctx, ZSTD_c_nbWorkers, p_settings.threads);
+	}
+}
+
+int64_t Compression::compress(uint8_t *p_dst, int64_t p_dst_max_size, const uint8_t *p_src, int64_t p_src_size,
+		const CompressionSettings &p_settings) {
+	ZSTD_CCtx *cctx = _get_thread_cctx();
+	if (cctx == nullptr) {
+		return -1;
+	}
+	_setup_cctx(cctx, p_src_size, p_settings);
+	size_t ret = ZSTD_compress2(cctx, p_dst, p_dst_max_size, p_src, p_src_size);
+	if (ZSTD_isError(ret)) {
+		return -1;
+	}
+	return ret;
+}
+
+int64_t Compression::get_decompressed_size(const uint8_t *p_src, int64_t p_src_size) {
+	unsigned long long size = ZSTD_getFrameContentSize(p_src, p_src_size);
+	if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR || size > INT64_MAX) {
+		return -1;
+	}
+	return size;
+}
+
+int64_t Compression::decompress(uint8_t *p_dst, int64_t p_dst_max_size, const uint8_t *p_src, int64_t p_src_size) {
+	ZSTD_DCtx *dctx = _get_thread_dctx();
+	if (dctx == nullptr) {
+		return -1;
+	}
+	size_t ret = ZSTD_decompressDCtx(dctx, p_dst, p_dst_max_size, p_src, p_src_size);
+	if (ZSTD_isError(ret)) {
+		return -1;
+	}
+	return ret;
+}
+
+void CompressionStream::begin(PackedByteArray &r_output, int64_t p_output_offset, int64_t p_src_size,
+		const CompressionSettings &p_settings) {
+	cctx = Compression::_get_thread_cctx();
+	output = &r_output;
+	output_pos = p_output_offset;
+	staging_pos = 0;
+	failed = cctx == nullptr;
+	if (failed) {
+		return;
+	}
+	Compression::_setup_cctx(cctx, p_src_size, p_settings);
+	// The frame header carries the content size, like the one-shot compression.
+	ZSTD_CCtx_setPledgedSrcSize(cctx, p_src_size);
+	staging.resize(ZSTD_CStreamInSize());
+	// Start from a guess of the compressed size and grow when needed.
+	output->resize(p_output_offset + MAX((int64_t)ZSTD_CStreamOutSize(), p_src_size / 4));
+}
+
+void CompressionStream::_flush(bool p_end) {
+	ZSTD_inBuffer in = { staging.ptr(), staging_pos, 0 };
+	ZSTD_EndDirective mode = p_end ? ZSTD_e_end : ZSTD_e_continue;
+	while (!failed) {
+		if (output_pos == output->size()) {
+			output->resize(output->size() * 2);
+		}
+		ZSTD_outBuffer out = { output->ptrw() + output_pos, size_t(output->size() - output_pos), 0 };
+		size_t remaining = ZSTD_compressStream2(cctx, &out, &in, mode);
+		output_pos += out.pos;
+		if (ZSTD_isError(remaining)) {
+			failed = true;
+		} else if (p_end ? remaining == 0 : in.pos == in.size) {
+			break;
+		}
+	}
+	staging_pos = 0;
+}
+
+uint8_t *CompressionStream::reserve(uint32_t p_size) {
+	if (staging_pos + p_size > staging.size()) {
+		_flush(false);
+		if (p_size > staging.size()) {
+			staging.resize(p_size);
+		}
+	}
+	uint8_t *w = staging.ptr() + staging_pos;
+	staging_pos += p_size;
+	return w;
+}
+
+bool CompressionStream::finish() {
+	_flush(true);
+	output->resize(output_pos);
+	return !failed;
+}
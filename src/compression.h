@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <godot_cpp/templates/local_vector.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <cstdint>
+
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+
+#define ZSTD_DEFAULT_LEVEL 3
+#define ZSTD_WINDOW_LOG_MAX 27
+
+namespace godot {
+
+struct CompressionSettings {
+	int level = ZSTD_DEFAULT_LEVEL;
+	bool long_distance_matching = false;
+	int threads = 0; // Worker threads, 0 compresses on the calling thread.
+	int64_t multithread_min_size = 8 * 1024 * 1024; // Payloads below this ignore threads.
+	bool streaming = false; // Feed sections to zstd as they are serialized instead of building the payload first.
+};
+
+// Direct access to the bundled zstd, so payloads can be compressed from and into
+// existing buffers without going through PackedByteArray::compress().
+class Compression {
+	friend class CompressionStream;
+
+	static ZSTD_CCtx *_get_thread_cctx();
+	static ZSTD_DCtx *_get_thread_dctx();
+	static void _setup_cctx(ZSTD_CCtx *p_cctx, int64_t p_src_size, const CompressionSettings &p_settings);
+
+public:
+	static int64_t get_max_compressed_size(int64_t p_src_size);
+	// Returns the size of the compressed data written to p_dst, or -1 on failure.
+	static int64_t compress(uint8_t *p_dst, int64_t p_dst_max_size, const uint8_t *p_src, int64_t p_src_size,
+			const CompressionSettings &p_settings = CompressionSettings());
+	// Returns the decompressed size a zstd frame declares, or -1 if it isn't a frame or doesn't declare it.
+	static int64_t get_decompressed_size(const uint8_t *p_src, int64_t p_src_size);
+	// Returns the size of the decompressed data written to p_dst, or -1 on failure.
+	static int64_t decompress(uint8_t *p_dst, int64_t p_dst_max_size, const uint8_t *p_src, int64_t p_src_size);
+};
+
+// Compresses data into a PackedByteArray as it is produced, with a small staging buffer in
+// between, so the uncompressed payload never has to exist in memory as a whole.
+class CompressionStream {
+	ZSTD_CCtx *cctx = nullptr;
+	PackedByteArray *output = nullptr;
+	int64_t output_pos = 0;
+	LocalVector<uint8_t> staging;
+	uint32_t staging_pos = 0;
+	bool failed = false;
+
+	void _flush(bool p_end);
+
+public:
+	// Output is appended to r_output from p_output_offset on, p_src_size must be the exact total.
+	void begin(PackedByteArray &r_output, int64_t p_output_offset, int64_t p_src_size,
+			const CompressionSettings &p_settings = CompressionSettings());
+	// Returns room for exactly p_size bytes, valid until the next call.
+	uint8_t *reserve(uint32_t p_size);
+	// Returns false if compression failed at any point. The output is trimmed to its final size.
+	bool finish();
+};
+
+} //namespace godot
+
+#endif // COMPRESSION_H
@@ -1128,6 +1128,22 @@ GDScriptTokenizer::Token GDScriptTokenizerText::string() {
 	return make_literal(string);
 }
 
+// The directive is a comment to the engine, which rejects unknown annotations. Its '#' is skipped
+// without taking a column, so the annotation starts where the code of the line would.
+bool GDScriptTokenizerText::_is_feature_directive() {
+	static const char32_t directive[] = U"#@if_feature";
+	if (!feature_directives) {
+		return false;
+	}
+	int i = 0;
+	for (; directive[i] != 0; i++) {
+		if (_peek(i) != directive[i]) {
+			return false;
+		}
+	}
+	return !is_unicode_identifier_continue(_peek(i));
+}
+
 void GDScriptTokenizerText::check_indent() {
 	ERR_FAIL_COND_MSG(column != 1, "Checking tokenizer indentation in the middle of a line.");
 
@@ -1142,6 +1158,12 @@ void GDScriptTokenizerText::check_indent() {
 		char32_t current_indent_char = _peek();
 		int indent_count = 0;
 
+		if (current_indent_char == '#' && _is_feature_directive()) {
+			_advance();
+			column--;
+			current_indent_char = _peek();
+		}
+
 		if (current_indent_char != ' ' && current_indent_char != '\t' && current_indent_char != '\r' && current_indent_char != '\n' && current_indent_char != '#') {
 			// First character of the line is not whitespace, so we clear all indentation levels.
 			// Unless we are in a continuation or in multiline mode (inside expression).
@@ -1202,7 +1224,10 @@ void GDScriptTokenizerText::check_indent() {
 			newline(false);
 			continue;
 		}
-		if (_peek() == '#') {
+		if (_is_feature_directive()) {
+			_advance();
+			column--;
+		} else if (_peek() == '#') {
 			// Comment. Advance to the next line.
 			while (_peek() != '\n' && !_is_at_end()) {
 				_advance();
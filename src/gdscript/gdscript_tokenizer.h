@@ -236,6 +236,7 @@ class GDScriptTokenizerText : public GDScriptTokenizer {
 	int position = 0;
 	int length = 0;
 	Vector<int> continuation_lines;
+	bool feature_directives = false;
 
 	_FORCE_INLINE_ bool _is_at_end() { return position >= length; }
 	_FORCE_INLINE_ char32_t _peek(int p_offset = 0) { return position + p_offset >= 0 && position + p_offset < length ? _current[p_offset] : '\0'; }
@@ -247,6 +248,7 @@ class GDScriptTokenizerText : public GDScriptTokenizer {
 	String _get_indent_char_name(char32_t ch);
 	void _skip_whitespace();
 	void check_indent();
+	bool _is_feature_directive();
 
 	Token make_error(const String &p_message);
 	void push_error(const String &p_message);
@@ -269,6 +271,8 @@ public:
 	void set_source_code(const String &p_source_code);
 
 	const Vector<int> &get_continuation_lines() const { return continuation_lines; }
+	// Reads "#@if_feature" comments at the start of a line as @if_feature annotations.
+	void set_feature_directives(bool p_enabled) { feature_directives = p_enabled; }
 
 	virtual int get_cursor_line() const override;
 	virtual int get_cursor_column() const override;
@@ -29,15 +29,289 @@
 /**************************************************************************/
 
 #include "gdscript_tokenizer_buffer.h"
+#include "identifier_codec.h"
+#include "marshalls.h"
+#include "token_transforms.h"
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/templates/sort_array.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
-#include <godot_cpp/classes/file_access.hpp>
 
 using namespace godot;
 
-int GDScriptTokenizerBuffer::_token_to_binary(const Token &p_token, PackedByteArray &r_buffer, int p_start, HashMap<StringName, uint32_t> &r_identifiers_map, HashMap<Variant, uint32_t, VariantHasher, VariantComparator> &r_constants_map) {
-	int pos = p_start;
+// Folds -0.0 into 0.0 and every NaN together, the same way Variant compares floats.
+static uint64_t _float_pool_key(double p_value) {
+	if (p_value == 0.0) {
+		return 0;
+	}
+	if (Math::is_nan(p_value)) {
+		return 0x7ff8000000000000;
+	}
+	uint64_t key;
+	memcpy(&key, &p_value, sizeof(double));
+	return key;
+}
+
+uint32_t GDScriptTokenizerBuffer::ConstantPool::add(const Variant &p_value) {
+	uint32_t pos = values.size();
+
+	switch (p_value.get_type()) {
+		case Variant::NIL: {
+			if (nil_pos >= 0) {
+				return nil_pos;
+			}
+			nil_pos = pos;
+		} break;
+		case Variant::BOOL: {
+			int value = bool(p_value) ? 1 : 0;
+			if (bool_pos[value] >= 0) {
+				return bool_pos[value];
+			}
+			bool_pos[value] = pos;
+		} break;
+		case Variant::INT: {
+			int64_t value = p_value;
+			const uint32_t *existing = ints.getptr(value);
+			if (existing) {
+				return *existing;
+			}
+			ints.insert(value, pos);
+		} break;
+		case Variant::FLOAT: {
+			uint64_t key = _float_pool_key(p_value);
+			const uint32_t *existing = floats.getptr(key);
+			if (existing) {
+				return *existing;
+			}
+			floats.insert(key, pos);
+		} break;
+		case Variant::STRING: {
+			String value = p_value;
+			const uint32_t *existing = strings.getptr(value);
+			if (existing) {
+				return *existing;
+			}
+			strings.insert(value, pos);
+		} break;
+		case Variant::STRING_NAME: {
+			StringName value = p_value;
+			const uint32_t *existing = string_names.getptr(value);
+			if (existing) {
+				return *existing;
+			}
+			string_names.insert(value, pos);
+		} break;
+		case Variant::NODE_PATH: {
+			String value = String(NodePath(p_value));
+			const uint32_t *existing = node_paths.getptr(value);
+			if (existing) {
+				return *existing;
+			}
+			node_paths.insert(value, pos);
+		} break;
+		default: {
+			// Not produced by the tokenizer, kept only for completeness.
+			const uint32_t *existing = others.getptr(p_value);
+			if (existing) {
+				return *existing;
+			}
+			others.insert(p_value, pos);
+		} break;
+	}
+
+	values.push_back(p_value);
+	sizes.push_back(_encode_constant(p_value, nullptr));
+	encoded_size += sizes[pos];
+	return pos;
+}
+
+namespace {
+
+// Hands out room for the next serialized bytes, either straight in the final buffer or in the
+// staging area of a compression stream.
+struct ContentsWriter {
+	uint8_t *direct = nullptr;
+	CompressionStream *stream = nullptr;
+
+	_FORCE_INLINE_ uint8_t *reserve(uint32_t p_size) {
+		if (stream) {
+			return stream->reserve(p_size);
+		}
+		uint8_t *w = direct;
+		direct += p_size;
+		return w;
+	}
+};
+
+} // namespace
+
+namespace {
+
+// Entries used at least this many times go first, by descending use, so the most common token words
+// repeat the same few indices. The rest is grouped so that similar entries end up next to each other.
+const uint32_t REORDER_HOT_USES = 8;
+
+struct IdentifierOrder {
+	const Vector<String> *identifiers = nullptr;
+	const LocalVector<uint32_t> *uses = nullptr;
+
+	bool operator()(uint32_t p_a, uint32_t p_b) const {
+		uint32_t uses_a = (*uses)[p_a];
+		uint32_t uses_b = (*uses)[p_b];
+		bool hot_a = uses_a >= REORDER_HOT_USES;
+		if (hot_a != (uses_b >= REORDER_HOT_USES)) {
+			return hot_a;
+		}
+		if (hot_a) {
+			if (uses_a != uses_b) {
+				return uses_a > uses_b;
+			}
+		} else if ((*identifiers)[p_a] != (*identifiers)[p_b]) {
+			return (*identifiers)[p_a] < (*identifiers)[p_b]; // Shared prefixes become adjacent.
+		}
+		return p_a < p_b;
+	}
+};
+
+struct ConstantOrder {
+	const LocalVector<Variant> *values = nullptr;
+	const LocalVector<uint32_t> *uses = nullptr;
+
+	bool operator()(uint32_t p_a, uint32_t p_b) const {
+		uint32_t uses_a = (*uses)[p_a];
+		uint32_t uses_b = (*uses)[p_b];
+		bool hot_a = uses_a >= REORDER_HOT_USES;
+		if (hot_a != (uses_b >= REORDER_HOT_USES)) {
+			return hot_a;
+		}
+		if (hot_a) {
+			if (uses_a != uses_b) {
+				return uses_a > uses_b;
+			}
+			return p_a < p_b;
+		}
+
+		// Grouped by type, then by value.
+		const Variant &a = (*values)[p_a];
+		const Variant &b = (*values)[p_b];
+		if (a.get_type() != b.get_type()) {
+			return a.get_type() < b.get_type();
+		}
+		switch (a.get_type()) {
+			case Variant::INT: {
+				if (int64_t(a) != int64_t(b)) {
+					return int64_t(a) < int64_t(b);
+				}
+			} break;
+			case Variant::FLOAT: {
+				if (double(a) < double(b) || double(b) < double(a)) {
+					return double(a) < double(b);
+				}
+			} break;
+			case Variant::STRING:
+			case Variant::STRING_NAME:
+			case Variant::NODE_PATH: {
+				String string_a = a;
+				String string_b = b;
+				if (string_a != string_b) {
+					return string_a < string_b;
+				}
+			} break;
+			default:
+				break;
+		}
+		return p_a < p_b;
+	}
+};
+
+} // namespace
+
+void GDScriptTokenizerBuffer::_reorder_tables(LocalVector<uint32_t> &r_token_buffer, Vector<String> &r_identifiers, ConstantPool &r_constants) {
+	// Count uses per entry.
+	LocalVector<uint32_t> identifier_uses;
+	LocalVector<uint32_t> constant_uses;
+	identifier_uses.resize(r_identifiers.size());
+	constant_uses.resize(r_constants.values.size());
+	memset(identifier_uses.ptr(), 0, identifier_uses.size() * sizeof(uint32_t));
+	memset(constant_uses.ptr(), 0, constant_uses.size() * sizeof(uint32_t));
+	for (uint32_t i = 0; i < r_token_buffer.size(); i += 2) {
+		uint32_t token_type = r_token_buffer[i];
+		switch (token_type & TOKEN_MASK) {
+			case Token::ANNOTATION:
+			case Token::IDENTIFIER:
+				identifier_uses[token_type >> TOKEN_BITS]++;
+				break;
+			case Token::ERROR:
+			case Token::LITERAL:
+				constant_uses[token_type >> TOKEN_BITS]++;
+				break;
+			default:
+				break;
+		}
+	}
+
+	// Sort the old indices. Ties are broken by first appearance, so the order is total and the
+	// output stays deterministic.
+	LocalVector<uint32_t> identifier_order;
+	identifier_order.resize(r_identifiers.size());
+	for (uint32_t i = 0; i < identifier_order.size(); i++) {
+		identifier_order[i] = i;
+	}
+	SortArray<uint32_t, IdentifierOrder> identifier_sorter;
+	identifier_sorter.compare.identifiers = &r_identifiers;
+	identifier_sorter.compare.uses = &identifier_uses;
+	identifier_sorter.sort(identifier_order.ptr(), identifier_order.size());
+
+	LocalVector<uint32_t> constant_order;
+	constant_order.resize(r_constants.values.size());
+	for (uint32_t i = 0; i < constant_order.size(); i++) {
+		constant_order[i] = i;
+	}
+	SortArray<uint32_t, ConstantOrder> constant_sorter;
+	constant_sorter.compare.values = &r_constants.values;
+	constant_sorter.compare.uses = &constant_uses;
+	constant_sorter.sort(constant_order.ptr(), constant_order.size());
 
-	int token_type = p_token.type & TOKEN_MASK;
+	// Move the entries and rewrite the token indices to match. The uses are no longer needed,
+	// so they are reused for the new index of each old entry.
+	Vector<String> identifiers;
+	identifiers.resize(r_identifiers.size());
+	for (uint32_t i = 0; i < identifier_order.size(); i++) {
+		identifiers.set(i, r_identifiers[identifier_order[i]]);
+		identifier_uses[identifier_order[i]] = i;
+	}
+	r_identifiers = identifiers;
+
+	LocalVector<Variant> values;
+	LocalVector<uint32_t> sizes;
+	values.resize(constant_order.size());
+	sizes.resize(constant_order.size());
+	for (uint32_t i = 0; i < constant_order.size(); i++) {
+		values[i] = r_constants.values[constant_order[i]];
+		sizes[i] = r_constants.sizes[constant_order[i]];
+		constant_uses[constant_order[i]] = i;
+	}
+	r_constants.values = values;
+	r_constants.sizes = sizes;
+
+	for (uint32_t i = 0; i < r_token_buffer.size(); i += 2) {
+		uint32_t token_type = r_token_buffer[i];
+		switch (token_type & TOKEN_MASK) {
+			case Token::ANNOTATION:
+			case Token::IDENTIFIER:
+				r_token_buffer[i] = (token_type & TOKEN_MASK) | (identifier_uses[token_type >> TOKEN_BITS] << TOKEN_BITS);
+				break;
+			case Token::ERROR:
+			case Token::LITERAL:
+				r_token_buffer[i] = (token_type & TOKEN_MASK) | (constant_uses[token_type >> TOKEN_BITS] << TOKEN_BITS);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+uint32_t GDScriptTokenizerBuffer::_token_to_binary(const Token &p_token, HashMap<StringName, uint32_t> &r_identifiers_map, ConstantPool &r_constants) {
+	uint32_t token_type = p_token.type & TOKEN_MASK;
 
 	switch (p_token.type) {
 		case GDScriptTokenizer::Token::ANNOTATION:
@@ -55,165 +329,652 @@ int GDScriptTokenizerBuffer::_token_to_binary(const Token &p_token, PackedByteAr
 		} break;
 		case GDScriptTokenizer::Token::ERROR:
 		case GDScriptTokenizer::Token::LITERAL: {
-			// Add literal to map.
-			int constant_pos;
-			if (r_constants_map.has(p_token.literal)) {
-				constant_pos = r_constants_map[p_token.literal];
-			} else {
-				constant_pos = r_constants_map.size();
-				r_constants_map[p_token.literal] = constant_pos;
-			}
-			token_type |= constant_pos << TOKEN_BITS;
+			// Add literal to its pool.
+			token_type |= r_constants.add(p_token.literal) << TOKEN_BITS;
 		} break;
 		default:
 			break;
 	}
 
-	// Encode token.
+	return token_type;
+}
+
+int GDScriptTokenizerBuffer::_encode_token(uint32_t p_token_type, uint32_t p_line, uint8_t *r_buffer) {
+	// Must agree with _get_token_size().
 	int token_len;
-	if (token_type & TOKEN_MASK) {
+	if (p_token_type & TOKEN_MASK) {
 		token_len = 8;
-		r_buffer.resize(pos + token_len);
-		r_buffer.encode_u32(pos, token_type | TOKEN_BYTE_MASK);
-		pos += 4;
+		encode_uint32(p_token_type | TOKEN_BYTE_MASK, r_buffer);
+		r_buffer += 4;
 	} else {
 		token_len = 5;
-		r_buffer.resize(pos + token_len);
-		r_buffer.set(pos, token_type);
-		pos++;
+		*r_buffer = p_token_type;
+		r_buffer++;
 	}
-	r_buffer.encode_u32(pos, p_token.start_line);
+	encode_uint32(p_line, r_buffer);
 	return token_len;
 }
 
-PackedByteArray GDScriptTokenizerBuffer::parse_code_string(const String &p_code, CompressMode p_compress_mode) {
+static int _encode_string(const String &p_string, uint8_t *r_buffer) {
+	CharString utf8 = p_string.utf8();
+	int len = utf8.length();
+	int pad = (4 - len % 4) % 4;
+	if (r_buffer) {
+		encode_uint32(len, r_buffer);
+		memcpy(r_buffer + 4, utf8.get_data(), len);
+		memset(r_buffer + 4 + len, 0, pad);
+	}
+	return 4 + len + pad;
+}
+
+int GDScriptTokenizerBuffer::_encode_constant(const Variant &p_value, uint8_t *r_buffer) {
+	// Same layout as the engine's encode_variant() for the literal types the tokenizer produces.
+	// When r_buffer is null only the encoded length is computed.
+	uint8_t *buf = r_buffer;
+	int len = 0;
+
+	switch (p_value.get_type()) {
+		case Variant::NIL: {
+			if (buf) {
+				encode_uint32(Variant::NIL, buf);
+			}
+			len = 4;
+		} break;
+		case Variant::BOOL: {
+			if (buf) {
+				encode_uint32(Variant::BOOL, buf);
+				encode_uint32(bool(p_value), buf + 4);
+			}
+			len = 8;
+		} break;
+		case Variant::INT: {
+			int64_t value = p_value;
+			if (value > (int64_t)INT32_MAX || value < (int64_t)INT32_MIN) {
+				if (buf) {
+					encode_uint32(Variant::INT | ENCODE_FLAG_64, buf);
+					encode_uint64(value, buf + 4);
+				}
+				len = 12;
+			} else {
+				if (buf) {
+					encode_uint32(Variant::INT, buf);
+					encode_uint32(int32_t(value), buf + 4);
+				}
+				len = 8;
+			}
+		} break;
+		case Variant::FLOAT: {
+			double d = p_value;
+			float f = d;
+			if (double(f) != d) {
+				if (buf) {
+					encode_uint32(Variant::FLOAT | ENCODE_FLAG_64, buf);
+					encode_double(d, buf + 4);
+				}
+				len = 12;
+			} else {
+				if (buf) {
+					encode_uint32(Variant::FLOAT, buf);
+					encode_float(f, buf + 4);
+				}
+				len = 8;
+			}
+		} break;
+		case Variant::STRING:
+		case Variant::STRING_NAME: {
+			if (buf) {
+				encode_uint32(p_value.get_type(), buf);
+			}
+			len = 4 + _encode_string(p_value, buf ? buf + 4 : nullptr);
+		} break;
+		case Variant::NODE_PATH: {
+			NodePath np = p_value;
+			int name_count = np.get_name_count();
+			int subname_count = np.get_subname_count();
+			if (buf) {
+				encode_uint32(Variant::NODE_PATH, buf);
+				encode_uint32(uint32_t(name_count) | 0x80000000, buf + 4); // For compatibility with the old format.
+				encode_uint32(subname_count, buf + 8);
+				encode_uint32(np.is_absolute() ? 1 : 0, buf + 12);
+			}
+			len = 16;
+			for (int i = 0; i < name_count + subname_count; i++) {
+				String str = i < name_count ? String(np.get_name(i)) : String(np.get_subname(i - name_count));
+				len += _encode_string(str, buf ? buf + len : nullptr);
+			}
+		} break;
+		default: {
+			PackedByteArray encoded = UtilityFunctions::var_to_bytes(p_value);
+			if (buf) {
+				memcpy(buf, encoded.ptr(), encoded.size());
+			}
+			len = encoded.size();
+		} break;
+	}
+
+	return len;
+}
+
+static int _decode_string(const uint8_t *p_buffer, uint32_t p_size, String *r_string) {
+	if (p_size < 4) {
+		return -1;
+	}
+	uint32_t len = decode_uint32(p_buffer);
+	uint32_t pad = (4 - len % 4) % 4;
+	if (uint64_t(len) + pad > p_size - 4) {
+		return -1;
+	}
+	if (r_string) {
+		*r_string = String::utf8((const char *)p_buffer + 4, len);
+	}
+	return 4 + len + pad;
+}
+
+int GDScriptTokenizerBuffer::_decode_constant(const uint8_t *p_buffer, uint32_t p_size, Variant *r_value) {
+	// Inverse of _encode_constant(), returns the encoded length or -1 if the data is invalid.
+	// When r_value is null the value is only measured. Types the tokenizer never produces are rejected,
+	// their length can't be known without the engine's decode_variant().
+	if (p_size < 4) {
+		return -1;
+	}
+	uint32_t header = decode_uint32(p_buffer);
+	const uint8_t *buf = p_buffer + 4;
+	int len = 4;
+
+	switch (header & 0xFF) {
+		case Variant::NIL: {
+			if (r_value) {
+				*r_value = Variant();
+			}
+		} break;
+		case Variant::BOOL: {
+			if (p_size < 8) {
+				return -1;
+			}
+			if (r_value) {
+				*r_value = decode_uint32(buf) != 0;
+			}
+			len += 4;
+		} break;
+		case Variant::INT: {
+			if (header & ENCODE_FLAG_64) {
+				if (p_size < 12) {
+					return -1;
+				}
+				if (r_value) {
+					*r_value = int64_t(decode_uint64(buf));
+				}
+				len += 8;
+			} else {
+				if (p_size < 8) {
+					return -1;
+				}
+				if (r_value) {
+					*r_value = int32_t(decode_uint32(buf));
+				}
+				len += 4;
+			}
+		} break;
+		case Variant::FLOAT: {
+			if (header & ENCODE_FLAG_64) {
+				if (p_size < 12) {
+					return -1;
+				}
+				if (r_value) {
+					*r_value = decode_double(buf);
+				}
+				len += 8;
+			} else {
+				if (p_size < 8) {
+					return -1;
+				}
+				if (r_value) {
+					*r_value = decode_float(buf);
+				}
+				len += 4;
+			}
+		} break;
+		case Variant::STRING:
+		case Variant::STRING_NAME: {
+			String str;
+			int str_len = _decode_string(buf, p_size - 4, r_value ? &str : nullptr);
+			if (str_len < 0) {
+				return -1;
+			}
+			if (r_value) {
+				*r_value = (header & 0xFF) == Variant::STRING ? Variant(str) : Variant(StringName(str));
+			}
+			len += str_len;
+		} break;
+		case Variant::NODE_PATH: {
+			if (p_size < 16) {
+				return -1;
+			}
+			uint32_t name_count = decode_uint32(buf);
+			uint32_t subname_count = decode_uint32(buf + 4);
+			bool absolute = decode_uint32(buf + 8) & 1;
+			if (!(name_count & 0x80000000)) {
+				return -1; // Old format, never written by the tokenizer.
+			}
+			name_count &= 0x7FFFFFFF;
+			len += 12;
+			String path = absolute ? "/" : "";
+			for (uint32_t i = 0; i < name_count + subname_count; i++) {
+				String str;
+				int str_len = _decode_string(p_buffer + len, p_size - len, r_value ? &str : nullptr);
+				if (str_len < 0) {
+					return -1;
+				}
+				len += str_len;
+				if (r_value) {
+					if (i >= name_count) {
+						path += ":";
+					} else if (i > 0) {
+						path += "/";
+					}
+					path += str;
+				}
+			}
+			if (r_value) {
+				*r_value = NodePath(path);
+			}
+		} break;
+		default:
+			return -1;
+	}
+
+	return len;
+}
+
+// The output only depends on the source and the compression settings. Tables are ordered by first
+// appearance, never by hash iteration, every byte is written explicitly including padding and the
+// unused count word, and all values are stored little-endian.
+PackedByteArray GDScriptTokenizerBuffer::parse_code_string(const String &p_code, CompressMode p_compress_mode,
+		const CompressionSettings &p_compression_settings, const ParseOptions &p_options, ParseReport *r_report) {
 	HashMap<StringName, uint32_t> identifier_map;
-	HashMap<Variant, uint32_t, VariantHasher, VariantComparator> constant_map;
-	PackedByteArray token_buffer;
-	HashMap<uint32_t, uint32_t> token_lines;
-	HashMap<uint32_t, uint32_t> token_columns;
+	ConstantPool constants;
+	LocalVector<uint32_t> token_buffer; // Pairs of encoded token type and line.
+	LocalVector<uint32_t> token_lines; // Pairs of token index and line, sorted by index.
+	LocalVector<uint32_t> token_columns; // Pairs of token index and column, sorted by index.
 
 	GDScriptTokenizerText tokenizer;
 	tokenizer.set_source_code(p_code);
 	tokenizer.set_multiline_mode(true); // Ignore whitespace tokens.
-	Token current = tokenizer.scan();
-	int token_pos = 0;
+
+	// Transforms need the whole script, otherwise tokens are encoded as they are scanned.
+	// Feature annotations must never reach the engine, a plain search tells if there are any.
+	bool filter_features = p_code.contains("@if_feature");
+	tokenizer.set_feature_directives(filter_features);
+	bool transform = filter_features || p_options.transforms_tokens();
+	LocalVector<Token> transformed;
+	uint32_t transformed_pos = 0;
+	if (transform) {
+		for (Token token = tokenizer.scan(); token.type != Token::TK_EOF; token = tokenizer.scan()) {
+			transformed.push_back(token);
+		}
+		if (filter_features) {
+			TokenTransforms::filter_features(transformed, tokenizer.get_continuation_lines(), p_options.features);
+		}
+		if (p_options.strip_debug || !p_options.stripped_calls.is_empty()) {
+			TokenTransforms::strip_statements(transformed, tokenizer.get_continuation_lines(),
+					p_options.strip_debug, p_options.stripped_calls);
+		}
+		uint32_t minified_bytes = 0;
+		if (p_options.minify_locals) {
+			minified_bytes = TokenTransforms::minify_locals(transformed, tokenizer.get_continuation_lines());
+		}
+		if (r_report != nullptr) {
+			r_report->minified_bytes = minified_bytes;
+		}
+		transformed.push_back(Token(Token::TK_EOF));
+	}
+
+	Token current = transform ? transformed[transformed_pos++] : tokenizer.scan();
 	int last_token_line = 0;
 	int token_counter = 0;
+	uint32_t tokens_size = 0;
 
+	// First pass: tokenize and measure, nothing is written to the output yet.
 	while (current.type != Token::TK_EOF) {
-		int token_len = _token_to_binary(current, token_buffer, token_pos, identifier_map, constant_map);
-		token_pos += token_len;
+		if (current.type == Token::ERROR && r_report != nullptr) {
+			r_report->errors.push_back(current);
+		}
+		uint32_t token_type = _token_to_binary(current, identifier_map, constants);
+		token_buffer.push_back(token_type);
+		token_buffer.push_back(current.start_line);
+		tokens_size += _get_token_size(token_type);
 		if (token_counter > 0 && current.start_line > last_token_line) {
-			token_lines[token_counter] = current.start_line;
-			token_columns[token_counter] = current.start_column;
+			token_lines.push_back(token_counter);
+			token_lines.push_back(current.start_line);
+			token_columns.push_back(token_counter);
+			token_columns.push_back(current.start_column);
 		}
 		last_token_line = current.end_line;
 
-		current = tokenizer.scan();
+		current = transform ? transformed[transformed_pos++] : tokenizer.scan();
 		token_counter++;
 	}
 
-	// Reverse maps.
-	Vector<StringName> rev_identifier_map;
+	// Reverse maps. Placed by index, the iteration order of the map doesn't matter.
+	Vector<String> rev_identifier_map;
 	rev_identifier_map.resize(identifier_map.size());
+	uint32_t identifiers_size = 0;
 	for (const KeyValue<StringName, uint32_t> &E : identifier_map) {
-		rev_identifier_map.set(E.value, E.key);
+		String s = E.key;
+		identifiers_size += (s.length() + 1) * 4;
+		rev_identifier_map.set(E.value, s);
 	}
-	Vector<Variant> rev_constant_map;
-	rev_constant_map.resize(constant_map.size());
-	for (const KeyValue<Variant, uint32_t> &E : constant_map) {
-		rev_constant_map.set(E.value, E.key);
-
+	for (const Variant &v : constants.values) {
+		// Objects cannot be constant, never encode objects.
+		ERR_FAIL_COND_V_MSG(v.get_type() == Variant::OBJECT, PackedByteArray(), "Error when trying to encode Variant.");
 	}
-	HashMap<uint32_t, uint32_t> rev_token_lines;
-	for (const KeyValue<uint32_t, uint32_t> &E : token_lines) {
-		rev_token_lines[E.value] = E.key;
+	if (p_options.reorder_tables) {
+		_reorder_tables(token_buffer, rev_identifier_map, constants);
 	}
 
-	// Remove continuation lines from map.
-	for (int line : tokenizer.get_continuation_lines()) {
-		if (rev_token_lines.has(line)) {
-			token_lines.erase(rev_token_lines[line]);
-			token_columns.erase(rev_token_lines[line]);
+	// Remove continuation lines. Both the recorded lines and the continuation lines are ascending,
+	// so a single merge pass compacts the tables in place.
+	const Vector<int> &continuation_lines = tokenizer.get_continuation_lines();
+	int continuation_pos = 0;
+	uint32_t line_count = 0;
+	for (uint32_t i = 0; i < token_lines.size(); i += 2) {
+		uint32_t line = token_lines[i + 1];
+		while (continuation_pos < continuation_lines.size() && (uint32_t)continuation_lines[continuation_pos] < line) {
+			continuation_pos++;
 		}
+		if (continuation_pos < continuation_lines.size() && (uint32_t)continuation_lines[continuation_pos] == line) {
+			continue;
+		}
+		token_lines[line_count * 2] = token_lines[i];
+		token_lines[line_count * 2 + 1] = line;
+		token_columns[line_count * 2] = token_columns[i];
+		token_columns[line_count * 2 + 1] = token_columns[i + 1];
+		line_count++;
 	}
+	token_lines.resize(line_count * 2);
+	token_columns.resize(line_count * 2);
+
+	// Second pass: the exact size is known, allocate once and write everything in place.
+	uint32_t contents_size = 20 + identifiers_size + constants.encoded_size + line_count * 16 + tokens_size;
 
+	PackedByteArray buf;
 	PackedByteArray contents;
-	contents.resize(20);
-	contents.encode_u32(0, identifier_map.size());
-	contents.encode_u32(4, constant_map.size());
-	contents.encode_u32(8, token_lines.size());
-	contents.encode_u32(12, 0);
-	contents.encode_u32(16, token_counter);
+	CompressionStream stream;
+	ContentsWriter writer;
+	bool streaming = p_compress_mode == COMPRESS_ZSTD && p_compression_settings.streaming;
+	if (p_compress_mode == COMPRESS_NONE) {
+		buf.resize(HEADER_SIZE + contents_size);
+		writer.direct = buf.ptrw() + HEADER_SIZE;
+	} else if (streaming) {
+		// Sections go to zstd as they are written, the uncompressed payload is never built.
+		stream.begin(buf, HEADER_SIZE, contents_size, p_compression_settings);
+		writer.stream = &stream;
+	} else {
+		contents.resize(contents_size);
+		writer.direct = contents.ptrw();
+	}
 
-	int buf_pos = 20;
+	uint8_t *w = writer.reserve(20);
+	encode_uint32(identifier_map.size(), w);
+	encode_uint32(constants.values.size(), w + 4);
+	encode_uint32(line_count, w + 8);
+	encode_uint32(0, w + 12); // Unused, the engine leaves it uninitialized.
+	encode_uint32(token_counter, w + 16);
 
 	// Save identifiers.
-	for (const StringName &id : rev_identifier_map) {
-		String s = String(id);
-		int len = s.length();
+	for (const String &s : rev_identifier_map) {
+		uint32_t len = s.length();
+		w = writer.reserve((len + 1) * 4);
+		encode_uint32(len, w);
+		encode_identifier(s.ptr(), len, w + 4);
+	}
 
-		contents.resize(buf_pos + (len + 1) * 4);
-		contents.encode_u32(buf_pos, len);
-		buf_pos += 4;
+	// Save constants.
+	for (uint32_t i = 0; i < constants.values.size(); i++) {
+		_encode_constant(constants.values[i], writer.reserve(constants.sizes[i]));
+	}
+
+	// Save lines and columns.
+	encode_uint32_array(token_lines.ptr(), token_lines.size(), writer.reserve(token_lines.size() * 4));
+	encode_uint32_array(token_columns.ptr(), token_columns.size(), writer.reserve(token_columns.size() * 4));
+
+	// Store tokens.
+	for (uint32_t i = 0; i < token_buffer.size(); i += 2) {
+		_encode_token(token_buffer[i], token_buffer[i + 1], writer.reserve(_get_token_size(token_buffer[i])));
+	}
+
+	if (streaming) {
+		ERR_FAIL_COND_V_MSG(!stream.finish(), PackedByteArray(), "Error when trying to compress binary tokens.");
+	} else if (p_compress_mode == COMPRESS_ZSTD) {
+		int64_t max_size = Compression::get_max_compressed_size(contents_size);
+		buf.resize(HEADER_SIZE + max_size);
+		int64_t compressed_size = Compression::compress(buf.ptrw() + HEADER_SIZE, max_size, contents.ptr(), contents_size, p_compression_settings);
+		ERR_FAIL_COND_V_MSG(compressed_size < 0, PackedByteArray(), "Error when trying to compress binary tokens.");
+		buf.resize(HEADER_SIZE + compressed_size);
+	}
+
+	// Save header.
+	uint8_t *header = buf.ptrw();
+	header[0] = 'G';
+	header[1] = 'D';
+	header[2] = 'S';
+	header[3] = 'C';
+	encode_uint32(TOKENIZER_VERSION, header + 4);
+	encode_uint32(p_compress_mode == COMPRESS_ZSTD ? contents_size : 0u, header + 8);
 
-		for (int i = 0; i < len; i++) {
-			contents.encode_u32(buf_pos, s[i] ^ 0xb6b6b6b6);
-			buf_pos += 4;
+	return buf;
+}
+
+Error GDScriptTokenizerBuffer::read_contents(const PackedByteArray &p_buffer, PackedByteArray &r_storage,
+		const uint8_t *&r_contents, uint32_t &r_size) {
+	const uint8_t *buf = p_buffer.ptr();
+	if (p_buffer.size() < HEADER_SIZE || buf[0] != 'G' || buf[1] != 'D' || buf[2] != 'S' || buf[3] != 'C') {
+		return ERR_INVALID_DATA;
+	}
+	if (decode_uint32(buf + 4) > TOKENIZER_VERSION) {
+		return ERR_INVALID_DATA; // Too recent, same as the engine.
+	}
+
+	uint32_t decompressed_size = decode_uint32(buf + 8);
+	if (decompressed_size == 0) {
+		// Read in place, no copy of the contents is needed.
+		r_contents = buf + HEADER_SIZE;
+		r_size = p_buffer.size() - HEADER_SIZE;
+		return OK;
+	}
+
+	r_storage.resize(decompressed_size);
+	int64_t result = Compression::decompress(r_storage.ptrw(), decompressed_size, buf + HEADER_SIZE, p_buffer.size() - HEADER_SIZE);
+	if (result != decompressed_size) {
+		return ERR_FILE_CORRUPT;
+	}
+	r_contents = r_storage.ptr();
+	r_size = decompressed_size;
+	return OK;
+}
+
+Error GDScriptTokenizerBuffer::get_section_offsets(const uint8_t *p_contents, uint32_t p_size, uint32_t r_offsets[SECTION_MAX + 1]) {
+	if (p_size < 20) {
+		return ERR_INVALID_DATA;
+	}
+	uint32_t identifier_count = decode_uint32(p_contents);
+	uint32_t constant_count = decode_uint32(p_contents + 4);
+	uint32_t token_line_count = decode_uint32(p_contents + 8);
+	uint32_t token_count = decode_uint32(p_contents + 16);
+	uint64_t pos = 20;
+
+	r_offsets[SECTION_IDENTIFIERS] = pos;
+	for (uint32_t i = 0; i < identifier_count; i++) {
+		if (pos + 4 > p_size) {
+			return ERR_INVALID_DATA;
+		}
+		pos += 4 + uint64_t(decode_uint32(p_contents + pos)) * 4;
+		if (pos > p_size) {
+			return ERR_INVALID_DATA;
 		}
 	}
 
-	// Save constants.
-	for (const Variant &v : rev_constant_map) {
-		// Objects cannot be constant, never encode objects.
-		ERR_FAIL_COND_V_MSG(v.get_type() == Variant::OBJECT, PackedByteArray(), "Error when trying to encode Variant.");
-		contents.append_array(UtilityFunctions::var_to_bytes(v));
+	r_offsets[SECTION_CONSTANTS] = pos;
+	for (uint32_t i = 0; i < constant_count; i++) {
+		int len = _decode_constant(p_contents + pos, p_size - pos, nullptr);
+		if (len < 0) {
+			return ERR_INVALID_DATA;
+		}
+		pos += len;
 	}
-	buf_pos = contents.size();
 
-	// Save lines and columns.
-	contents.resize(buf_pos + token_lines.size() * 16);
-	for (const KeyValue<uint32_t, uint32_t> &e : token_lines) {
-		contents.encode_u32(buf_pos, e.key);
-		buf_pos += 4;
-		contents.encode_u32(buf_pos, e.value);
-		buf_pos += 4;
+	// Both tables hold pairs of token index and value, with strictly ascending token indices.
+	if (pos + uint64_t(token_line_count) * 16 > p_size) {
+		return ERR_INVALID_DATA;
 	}
-	for (const KeyValue<uint32_t, uint32_t> &e : token_columns) {
-		contents.encode_u32(buf_pos, e.key);
-		buf_pos += 4;
-		contents.encode_u32(buf_pos, e.value);
-		buf_pos += 4;
+	for (int table = SECTION_LINES; table <= SECTION_COLUMNS; table++) {
+		r_offsets[table] = pos;
+		int64_t last_index = -1;
+		for (uint32_t i = 0; i < token_line_count; i++) {
+			uint32_t token_index = decode_uint32(p_contents + pos);
+			if (int64_t(token_index) <= last_index || token_index >= token_count) {
+				return ERR_INVALID_DATA;
+			}
+			last_index = token_index;
+			pos += 8;
+		}
 	}
 
-	// Store tokens.
-	contents.append_array(token_buffer);
+	r_offsets[SECTION_TOKENS] = pos;
+	for (uint32_t i = 0; i < token_count; i++) {
+		if (pos + 5 > p_size) {
+			return ERR_INVALID_DATA;
+		}
+		uint32_t token_type = p_contents[pos];
+		int token_len = 5;
+		if (token_type & TOKEN_BYTE_MASK) {
+			if (pos + 8 > p_size) {
+				return ERR_INVALID_DATA;
+			}
+			token_type = decode_uint32(p_contents + pos);
+			token_len = 8;
+		}
+		uint32_t index = token_len == 8 ? token_type >> TOKEN_BITS : 0;
+		switch (token_type & TOKEN_MASK) {
+			case Token::ANNOTATION:
+			case Token::IDENTIFIER: {
+				if (index >= identifier_count) {
+					return ERR_INVALID_DATA;
+				}
+			} break;
+			case Token::ERROR:
+			case Token::LITERAL: {
+				if (index >= constant_count) {
+					return ERR_INVALID_DATA;
+				}
+			} break;
+			default: {
+				if ((token_type & TOKEN_MASK) >= Token::TK_MAX) {
+					return ERR_INVALID_DATA;
+				}
+			} break;
+		}
+		pos += token_len;
+	}
 
-	PackedByteArray buf;
+	r_offsets[SECTION_MAX] = pos;
+	return pos == p_size ? OK : ERR_INVALID_DATA;
+}
 
-	// Save header.
-	buf.resize(HEADER_SIZE);
-	buf.set(0, 'G');
-	buf.set(1, 'D');
-	buf.set(2, 'S');
-	buf.set(3, 'C');
-	buf.encode_u32(4, TOKENIZER_VERSION);
-
-	switch (p_compress_mode) {
-		case COMPRESS_NONE:
-			buf.encode_u32(8, 0u);
-			buf.append_array(contents);
-			break;
+Error GDScriptTokenizerBuffer::set_code_buffer(const PackedByteArray &p_buffer) {
+	// Structure is validated up front, so sections are decoded without further bound checks.
+	// Nothing is printed, callers report errors in their own terms.
+	PackedByteArray storage;
+	const uint8_t *buf;
+	uint32_t size;
+	Error err = read_contents(p_buffer, storage, buf, size);
+	if (err != OK) {
+		return err;
+	}
+	uint32_t offsets[SECTION_MAX + 1];
+	err = get_section_offsets(buf, size, offsets);
+	if (err != OK) {
+		return err;
+	}
+
+	uint32_t identifier_count = decode_uint32(buf);
+	uint32_t constant_count = decode_uint32(buf + 4);
+	uint32_t token_line_count = decode_uint32(buf + 8);
+	uint32_t token_count = decode_uint32(buf + 16);
+
+	const uint8_t *b = buf + offsets[SECTION_IDENTIFIERS];
+	identifiers.resize(identifier_count);
+	LocalVector<char32_t> chars;
+	for (uint32_t i = 0; i < identifier_count; i++) {
+		uint32_t len = decode_uint32(b);
+		chars.resize(len + 1);
+		decode_identifier(b + 4, len, chars.ptr());
+		chars[len] = 0;
+		identifiers.write[i] = String(chars.ptr());
+		b += (len + 1) * 4;
+	}
+
+	b = buf + offsets[SECTION_CONSTANTS];
+	constants.resize(constant_count);
+	for (uint32_t i = 0; i < constant_count; i++) {
+		b += _decode_constant(b, buf + size - b, &constants.write[i]);
+	}
+
+	// Kept as the sorted pairs they are stored as, scan() walks them alongside the tokens.
+	b = buf + offsets[SECTION_LINES];
+	const uint8_t *c = buf + offsets[SECTION_COLUMNS];
+	token_lines.resize(token_line_count * 2);
+	token_columns.resize(token_line_count * 2);
+	for (uint32_t i = 0; i < token_line_count * 2; i++) {
+		token_lines[i] = decode_uint32(b + i * 4);
+		token_columns[i] = decode_uint32(c + i * 4);
+	}
+
+	b = buf + offsets[SECTION_TOKENS];
+	tokens.resize(token_count);
+	for (uint32_t i = 0; i < token_count; i++) {
+		tokens.write[i] = _binary_to_token(b);
+		b += (*b & TOKEN_BYTE_MASK) ? 8 : 5;
+	}
+
+	current = 0;
+	current_line = 1;
+	line_cursor = 0;
+	return OK;
+}
 
-		case COMPRESS_ZSTD: {
-			buf.encode_u32(8, contents.size());
-			contents = contents.compress(FileAccess::COMPRESSION_ZSTD);
-			buf.append_array(contents);
+GDScriptTokenizer::Token GDScriptTokenizerBuffer::_binary_to_token(const uint8_t *p_buffer) {
+	// Indices are known to be in range, get_section_offsets() checked them.
+	Token token;
+	const uint8_t *b = p_buffer;
+
+	uint32_t token_type;
+	if (*b & TOKEN_BYTE_MASK) {
+		token_type = decode_uint32(b);
+		b += 4;
+	} else {
+		token_type = *b;
+		b++;
+	}
+	token.type = (Token::Type)(token_type & TOKEN_MASK);
+	token.start_line = decode_uint32(b);
+	token.end_line = token.start_line;
+
+	// Other tokens don't carry their name as a literal, it's always available through get_name().
+	switch (token.type) {
+		case GDScriptTokenizer::Token::ANNOTATION:
+		case GDScriptTokenizer::Token::IDENTIFIER: {
+			token.literal = identifiers[token_type >> TOKEN_BITS];
+		} break;
+		case GDScriptTokenizer::Token::ERROR:
+		case GDScriptTokenizer::Token::LITERAL: {
+			token.literal = constants[token_type >> TOKEN_BITS];
 		} break;
+		default:
+			break;
 	}
 
-	return buf;
+	return token;
 }
 
 int GDScriptTokenizerBuffer::get_cursor_line() const {
@@ -241,8 +1002,8 @@ void GDScriptTokenizerBuffer::push_expression_indented_block() {
 
 void GDScriptTokenizerBuffer::pop_expression_indented_block() {
 	ERR_FAIL_COND(indent_stack_stack.is_empty());
-	indent_stack = indent_stack_stack.back()->get();
-	indent_stack_stack.pop_back();
+	indent_stack = indent_stack_stack[indent_stack_stack.size() - 1];
+	indent_stack_stack.resize(indent_stack_stack.size() - 1);
 }
 
 GDScriptTokenizer::Token GDScriptTokenizerBuffer::scan() {
@@ -275,7 +1036,7 @@ GDScriptTokenizer::Token GDScriptTokenizerBuffer::scan() {
 
 	if (current >= tokens.size()) {
 		if (!indent_stack.is_empty()) {
-			pending_indents -= indent_stack.size();
+			pending_indents -= (int)indent_stack.size();
 			indent_stack.clear();
 			return scan();
 		}
@@ -284,15 +1045,21 @@ GDScriptTokenizer::Token GDScriptTokenizerBuffer::scan() {
 		return eof;
 	};
 
-	if (!last_token_was_newline && token_lines.has(current)) {
-		current_line = token_lines[current];
-		uint32_t current_column = token_columns[current];
+	// Entries are sorted by token index, so the cursor only ever moves forward. Entries skipped
+	// while a newline was being emitted are passed over here.
+	while (line_cursor * 2 < token_lines.size() && token_lines[line_cursor * 2] < (uint32_t)current) {
+		line_cursor++;
+	}
+	if (!last_token_was_newline && line_cursor * 2 < token_lines.size() && token_lines[line_cursor * 2] == (uint32_t)current) {
+		current_line = token_lines[line_cursor * 2 + 1];
+		uint32_t current_column = token_columns[line_cursor * 2 + 1];
+		line_cursor++;
 
 		// Check if there's a need to indent/dedent.
 		if (!multiline_mode) {
 			uint32_t previous_indent = 0;
 			if (!indent_stack.is_empty()) {
-				previous_indent = indent_stack.back()->get();
+				previous_indent = indent_stack[indent_stack.size() - 1];
 			}
 			if (current_column - 1 > previous_indent) {
 				pending_indents++;
@@ -300,11 +1067,11 @@ GDScriptTokenizer::Token GDScriptTokenizerBuffer::scan() {
 			} else {
 				while (current_column - 1 < previous_indent) {
 					pending_indents--;
-					indent_stack.pop_back();
+					indent_stack.resize(indent_stack.size() - 1);
 					if (indent_stack.is_empty()) {
 						break;
 					}
-					previous_indent = indent_stack.back()->get();
+					previous_indent = indent_stack[indent_stack.size() - 1];
 				}
 			}
 
@@ -31,7 +31,9 @@
 #ifndef GDSCRIPT_TOKENIZER_BUFFER_H
 #define GDSCRIPT_TOKENIZER_BUFFER_H
 
+#include "compression.h"
 #include "gdscript_tokenizer.h"
+#include <godot_cpp/templates/local_vector.hpp>
 
 #define TOKENIZER_VERSION 100
 #define HEADER_SIZE 12
@@ -45,6 +47,16 @@ public:
 		COMPRESS_ZSTD,
 	};
 
+	// Sections of the contents that follow the header, in the order they are serialized.
+	enum Section {
+		SECTION_IDENTIFIERS,
+		SECTION_CONSTANTS,
+		SECTION_LINES,
+		SECTION_COLUMNS,
+		SECTION_TOKENS,
+		SECTION_MAX,
+	};
+
 	enum {
 		TOKEN_BYTE_MASK = 0x80,
 		TOKEN_BITS = 8,
@@ -54,22 +66,78 @@ public:
 	Vector<StringName> identifiers;
 	Vector<Variant> constants;
 	Vector<int> continuation_lines;
-	HashMap<int, int> token_lines;
-	HashMap<int, int> token_columns;
+	LocalVector<uint32_t> token_lines; // Pairs of token index and line, sorted by index.
+	LocalVector<uint32_t> token_columns; // Pairs of token index and column, sorted by index.
 	Vector<Token> tokens;
 	int current = 0;
 	uint32_t current_line = 1;
+	uint32_t line_cursor = 0; // Next entry of token_lines and token_columns, follows current.
 
 	bool multiline_mode = false;
-	List<int> indent_stack;
-	List<List<int>> indent_stack_stack; // For lambdas, which require manipulating the indentation point.
+	LocalVector<int> indent_stack;
+	LocalVector<LocalVector<int>> indent_stack_stack; // For lambdas, which require manipulating the indentation point.
 	int pending_indents = 0;
 	bool last_token_was_newline = false;
 
-	static int _token_to_binary(const Token &p_token, PackedByteArray &r_buffer, int p_start, HashMap<StringName, uint32_t> &r_identifiers_map, HashMap<Variant, uint32_t, VariantHasher, VariantComparator> &r_constants_map);
+	// Constants deduplicated in one pool per literal type, indexed in order of first appearance.
+	struct ConstantPool {
+		HashMap<int64_t, uint32_t> ints;
+		HashMap<uint64_t, uint32_t> floats;
+		HashMap<String, uint32_t> strings;
+		HashMap<StringName, uint32_t> string_names;
+		HashMap<String, uint32_t> node_paths;
+		HashMap<Variant, uint32_t, VariantHasher, VariantComparator> others;
+		int64_t nil_pos = -1;
+		int64_t bool_pos[2] = { -1, -1 };
+		LocalVector<Variant> values;
+		LocalVector<uint32_t> sizes; // Encoded size of each value.
+		uint32_t encoded_size = 0;
+
+		uint32_t add(const Variant &p_value);
+	};
+
+	// Options that change how the tokens are encoded, the result is always loadable by the engine.
+	struct ParseOptions {
+		bool reorder_tables = false; // Order the identifier and constant tables for compression instead of by first appearance.
+		bool minify_locals = false; // Rename function locals to short names, see TokenTransforms::minify_locals().
+		bool strip_debug = false; // Remove assert and breakpoint statements.
+		Vector<StringName> stripped_calls; // Remove statements that only call one of these.
+		Vector<StringName> features; // Enabled features for @if_feature annotations, which are always applied.
+
+		bool transforms_tokens() const { return minify_locals || strip_debug || !stripped_calls.is_empty(); }
+	};
+
+	// What the options did to the script.
+	struct ParseReport {
+		uint32_t minified_bytes = 0; // Saved in the identifier table by minify_locals.
+		LocalVector<Token> errors; // Tokenizer errors in source order, encoded like any other token.
+	};
+
+	static void _reorder_tables(LocalVector<uint32_t> &r_token_buffer, Vector<String> &r_identifiers, ConstantPool &r_constants);
+	static uint32_t _token_to_binary(const Token &p_token, HashMap<StringName, uint32_t> &r_identifiers_map, ConstantPool &r_constants);
+	static int _encode_constant(const Variant &p_value, uint8_t *r_buffer);
+	static int _decode_constant(const uint8_t *p_buffer, uint32_t p_size, Variant *r_value);
+	static int _encode_token(uint32_t p_token_type, uint32_t p_line, uint8_t *r_buffer);
+	Token _binary_to_token(const uint8_t *p_buffer);
+	static _FORCE_INLINE_ int _get_token_size(uint32_t p_token_type) {
+		// Same condition as the engine's 4.3 encoder, which always ends up using the long form.
+		return (p_token_type & TOKEN_MASK) ? 8 : 5;
+	}
 
 public:
-	static PackedByteArray parse_code_string(const String &p_code, CompressMode p_compress_mode);
+	// Returns the uncompressed contents that follow the header, decompressing them into r_storage if needed.
+	static Error read_contents(const PackedByteArray &p_buffer, PackedByteArray &r_storage,
+			const uint8_t *&r_contents, uint32_t &r_size);
+	// Walks the contents and fills r_offsets with the start of each section, plus the end of the last one.
+	// Bounds, counts and token indices are validated without decoding any value.
+	static Error get_section_offsets(const uint8_t *p_contents, uint32_t p_size, uint32_t r_offsets[SECTION_MAX + 1]);
+
+	Error set_code_buffer(const PackedByteArray &p_buffer);
+	// Re-entrant, any number of threads may call it at once: besides its arguments it only touches
+	// locals, the thread's own zstd context and the engine's error printing, which is thread-safe.
+	static PackedByteArray parse_code_string(const String &p_code, CompressMode p_compress_mode,
+			const CompressionSettings &p_compression_settings = CompressionSettings(),
+			const ParseOptions &p_options = ParseOptions(), ParseReport *r_report = nullptr);
 
 	virtual int get_cursor_line() const override;
 	virtual int get_cursor_column() const override;
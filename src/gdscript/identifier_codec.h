@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTIFIER_CODEC_H
+#define IDENTIFIER_CODEC_H
+
+#include "marshalls.h"
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IDENTIFIER_CODEC_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IDENTIFIER_CODEC_SSE2
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define IDENTIFIER_CODEC_NEON
+#endif
+
+#define IDENTIFIER_XOR_KEY 0xb6b6b6b6
+
+namespace godot {
+
+// Identifier characters are stored as little-endian u32 XOR'ed with IDENTIFIER_XOR_KEY.
+// The vector paths rely on little-endian stores matching encode_uint32(), so they are only
+// enabled on little-endian targets; the scalar loop handles the tail and everything else.
+
+static inline void encode_identifier(const char32_t *p_chars, uint32_t p_len, uint8_t *r_buffer) {
+	uint32_t i = 0;
+#if defined(IDENTIFIER_CODEC_AVX2)
+	const __m256i key = _mm256_set1_epi32((int)IDENTIFIER_XOR_KEY);
+	for (; i + 8 <= p_len; i += 8) {
+		__m256i chars = _mm256_loadu_si256((const __m256i *)(p_chars + i));
+		_mm256_storeu_si256((__m256i *)(r_buffer + i * 4), _mm256_xor_si256(chars, key));
+	}
+#elif defined(IDENTIFIER_CODEC_SSE2)
+	const __m128i key = _mm_set1_epi32((int)IDENTIFIER_XOR_KEY);
+	for (; i + 4 <= p_len; i += 4) {
+		__m128i chars = _mm_loadu_si128((const __m128i *)(p_chars + i));
+		_mm_storeu_si128((__m128i *)(r_buffer + i * 4), _mm_xor_si128(chars, key));
+	}
+#elif defined(IDENTIFIER_CODEC_NEON)
+	const uint32x4_t key = vdupq_n_u32(IDENTIFIER_XOR_KEY);
+	for (; i + 4 <= p_len; i += 4) {
+		uint32x4_t chars = vld1q_u32((const uint32_t *)(p_chars + i));
+		vst1q_u8(r_buffer + i * 4, vreinterpretq_u8_u32(veorq_u32(chars, key)));
+	}
+#endif
+	for (; i < p_len; i++) {
+		encode_uint32(p_chars[i] ^ IDENTIFIER_XOR_KEY, r_buffer + i * 4);
+	}
+}
+
+static inline void decode_identifier(const uint8_t *p_buffer, uint32_t p_len, char32_t *r_chars) {
+	uint32_t i = 0;
+#if defined(IDENTIFIER_CODEC_AVX2)
+	const __m256i key = _mm256_set1_epi32((int)IDENTIFIER_XOR_KEY);
+	for (; i + 8 <= p_len; i += 8) {
+		__m256i chars = _mm256_loadu_si256((const __m256i *)(p_buffer + i * 4));
+		_mm256_storeu_si256((__m256i *)(r_chars + i), _mm256_xor_si256(chars, key));
+	}
+#elif defined(IDENTIFIER_CODEC_SSE2)
+	const __m128i key = _mm_set1_epi32((int)IDENTIFIER_XOR_KEY);
+	for (; i + 4 <= p_len; i += 4) {
+		__m128i chars = _mm_loadu_si128((const __m128i *)(p_buffer + i * 4));
+		_mm_storeu_si128((__m128i *)(r_chars + i), _mm_xor_si128(chars, key));
+	}
+#elif defined(IDENTIFIER_CODEC_NEON)
+	const uint32x4_t key = vdupq_n_u32(IDENTIFIER_XOR_KEY);
+	for (; i + 4 <= p_len; i += 4) {
+		uint32x4_t chars = vreinterpretq_u32_u8(vld1q_u8(p_buffer + i * 4));
+		vst1q_u32((uint32_t *)(r_chars + i), veorq_u32(chars, key));
+	}
+#endif
+	for (; i < p_len; i++) {
+		r_chars[i] = decode_uint32(p_buffer + i * 4) ^ IDENTIFIER_XOR_KEY;
+	}
+}
+
+} // namespace godot
+
+#endif // IDENTIFIER_CODEC_H
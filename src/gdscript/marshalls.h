@@ -0,0 +1,130 @@
+/**************************************************************************/
+/*  marshalls.h                                                           */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef MARSHALLS_H
+#define MARSHALLS_H
+
+#include <cstdint>
+#include <cstring>
+
+// Subset of the engine's core/io/marshalls.h, which is not exposed to GDExtension.
+// Writing through these avoids a builtin method call per value on PackedByteArray.
+
+#define ENCODE_FLAG_64 (1 << 16)
+
+namespace godot {
+
+static inline unsigned int encode_uint32(uint32_t p_uint, uint8_t *p_arr) {
+	for (int i = 0; i < 4; i++) {
+		*p_arr = p_uint & 0xFF;
+		p_arr++;
+		p_uint >>= 8;
+	}
+
+	return sizeof(uint32_t);
+}
+
+static inline uint32_t decode_uint32(const uint8_t *p_arr) {
+	uint32_t u = 0;
+
+	for (int i = 0; i < 4; i++) {
+		uint32_t b = *p_arr;
+		b <<= (i * 8);
+		u |= b;
+		p_arr++;
+	}
+
+	return u;
+}
+
+static inline unsigned int encode_uint64(uint64_t p_uint, uint8_t *p_arr) {
+	for (int i = 0; i < 8; i++) {
+		*p_arr = p_uint & 0xFF;
+		p_arr++;
+		p_uint >>= 8;
+	}
+
+	return sizeof(uint64_t);
+}
+
+static inline uint64_t decode_uint64(const uint8_t *p_arr) {
+	uint64_t u = 0;
+
+	for (int i = 0; i < 8; i++) {
+		uint64_t b = (*p_arr) & 0xFF;
+		b <<= (i * 8);
+		u |= b;
+		p_arr++;
+	}
+
+	return u;
+}
+
+static inline unsigned int encode_float(float p_float, uint8_t *p_arr) {
+	uint32_t u;
+	memcpy(&u, &p_float, sizeof(float));
+	return encode_uint32(u, p_arr);
+}
+
+static inline float decode_float(const uint8_t *p_arr) {
+	uint32_t u = decode_uint32(p_arr);
+	float f;
+	memcpy(&f, &u, sizeof(float));
+	return f;
+}
+
+static inline unsigned int encode_double(double p_double, uint8_t *p_arr) {
+	uint64_t u;
+	memcpy(&u, &p_double, sizeof(double));
+	return encode_uint64(u, p_arr);
+}
+
+static inline double decode_double(const uint8_t *p_arr) {
+	uint64_t u = decode_uint64(p_arr);
+	double d;
+	memcpy(&d, &u, sizeof(double));
+	return d;
+}
+
+// Stores an array of u32 in little-endian order, which is a plain copy on little-endian hosts.
+static inline unsigned int encode_uint32_array(const uint32_t *p_array, uint32_t p_count, uint8_t *p_arr) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for (uint32_t i = 0; i < p_count; i++) {
+		encode_uint32(p_array[i], p_arr + i * 4);
+	}
+#else
+	memcpy(p_arr, p_array, p_count * sizeof(uint32_t));
+#endif
+	return p_count * sizeof(uint32_t);
+}
+
+} // namespace godot
+
+#endif // MARSHALLS_H
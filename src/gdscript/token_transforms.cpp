@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "token_transforms.h"
+#include "char_utils.h"
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/hash_set.hpp>
+
+using namespace godot;
+
+namespace {
+
+typedef GDScriptTokenizer::Token Token;
+
+// Statement structure of a token stream, per token.
+struct TokenLayout {
+	const LocalVector<Token> *tokens = nullptr;
+	LocalVector<uint8_t> line_start; // First token of a line that isn't a continuation line.
+	LocalVector<int> indent; // Indentation column of the line the token is on.
+	LocalVector<int> depth; // Bracket depth before the token.
+	LocalVector<uint8_t> in_brace; // The innermost open bracket is a brace.
+
+	void build(const LocalVector<Token> &p_tokens, const Vector<int> &p_continuation_lines) {
+		tokens = &p_tokens;
+		uint32_t count = p_tokens.size();
+		line_start.resize(count);
+		indent.resize(count);
+		depth.resize(count);
+		in_brace.resize(count);
+
+		LocalVector<Token::Type> brackets;
+		int continuation_pos = 0;
+		int line_indent = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			const Token &token = p_tokens[i];
+			bool starts_line = i == 0 || token.start_line > p_tokens[i - 1].end_line;
+			if (starts_line) {
+				while (continuation_pos < p_continuation_lines.size() && p_continuation_lines[continuation_pos] < token.start_line) {
+					continuation_pos++;
+				}
+				if (continuation_pos < p_continuation_lines.size() && p_continuation_lines[continuation_pos] == token.start_line) {
+					starts_line = false;
+				} else {
+					line_indent = token.start_column;
+				}
+			}
+			line_start[i] = starts_line;
+			indent[i] = line_indent;
+			depth[i] = brackets.size();
+			in_brace[i] = !brackets.is_empty() && brackets[brackets.size() - 1] == Token::BRACE_OPEN;
+
+			switch (token.type) {
+				case Token::BRACKET_OPEN:
+				case Token::BRACE_OPEN:
+				case Token::PARENTHESIS_OPEN:
+					brackets.push_back(token.type);
+					break;
+				case Token::BRACKET_CLOSE:
+				case Token::BRACE_CLOSE:
+				case Token::PARENTHESIS_CLOSE:
+					if (!brackets.is_empty()) {
+						brackets.resize(brackets.size() - 1);
+					}
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	// First token after p_token that is out of its block, or p_end. With p_body the block is the
+	// one p_token opens (for, func, or a statement after a colon on the same line), otherwise it's
+	// the block p_token is a statement of. Inside brackets, which only lambdas can open blocks in,
+	// a comma or closing bracket at the same depth ends the lambda too.
+	// Lines inside brackets that are plain continuations may end a block early, never late.
+	uint32_t block_end(uint32_t p_token, bool p_body, uint32_t p_end) const {
+		int token_depth = depth[p_token];
+		int limit = indent[p_token];
+		for (uint32_t i = p_token + 1; i < p_end; i++) {
+			if (depth[i] < token_depth || (token_depth > 0 && depth[i] == token_depth && (*tokens)[i].type == Token::COMMA)) {
+				return i;
+			}
+			if (line_start[i] && depth[i] <= token_depth && (p_body ? indent[i] <= limit : indent[i] < limit)) {
+				return i;
+			}
+		}
+		return p_end;
+	}
+
+	// First token of the statement after the one p_token is in, or p_end.
+	uint32_t next_statement(uint32_t p_token, uint32_t p_end) const {
+		int token_depth = depth[p_token];
+		for (uint32_t i = p_token + 1; i < p_end; i++) {
+			if (depth[i] < token_depth || (line_start[i] && depth[i] <= token_depth)) {
+				return i;
+			}
+			if ((*tokens)[i - 1].type == Token::SEMICOLON && depth[i - 1] == token_depth) {
+				return i;
+			}
+		}
+		return p_end;
+	}
+
+	// A FUNC that declares a method rather than a lambda.
+	bool is_method(uint32_t p_token) const {
+		if ((*tokens)[p_token].type != Token::FUNC || depth[p_token] != 0) {
+			return false;
+		}
+		if (line_start[p_token]) {
+			return true;
+		}
+		switch ((*tokens)[p_token - 1].type) {
+			case Token::STATIC:
+			case Token::ANNOTATION:
+			case Token::PARENTHESIS_CLOSE: // Annotation arguments.
+				return true;
+			default:
+				return false;
+		}
+	}
+};
+
+struct LocalDeclaration {
+	StringName name;
+	uint32_t token = 0; // The identifier being declared.
+	uint32_t scope_start = 0; // Range of tokens where the name refers to this declaration.
+	uint32_t scope_end = 0;
+};
+
+// Identifier tokens that aren't a reference to a variable: properties, method and lambda names,
+// calls, which never resolve to a variable, node paths and dictionary keys.
+bool is_variable_reference(const LocalVector<Token> &p_tokens, const TokenLayout &p_layout,
+		const LocalVector<uint8_t> &p_node_names, uint32_t p_token) {
+	if (p_tokens[p_token].type != Token::IDENTIFIER || p_node_names[p_token]) {
+		return false;
+	}
+	Token::Type previous = p_token > 0 ? p_tokens[p_token - 1].type : Token::EMPTY;
+	Token::Type next = p_token + 1 < p_tokens.size() ? p_tokens[p_token + 1].type : Token::EMPTY;
+	if (previous == Token::PERIOD || previous == Token::FUNC || next == Token::PARENTHESIS_OPEN) {
+		return false;
+	}
+	if (p_layout.in_brace[p_token] && next == Token::EQUAL && (previous == Token::BRACE_OPEN || previous == Token::COMMA)) {
+		return false;
+	}
+	return true;
+}
+
+void add_string_words(const String &p_string, HashSet<StringName> &r_words) {
+	const char32_t *chars = p_string.ptr();
+	int length = p_string.length();
+	int start = 0;
+	for (int i = 0; i <= length; i++) {
+		if (i < length && is_unicode_identifier_continue(chars[i])) {
+			continue;
+		}
+		if (i > start) {
+			r_words.insert(p_string.substr(start, i - start));
+		}
+		start = i + 1;
+	}
+}
+
+uint32_t identifier_table_size(const LocalVector<Token> &p_tokens) {
+	HashSet<StringName> names;
+	uint32_t size = 0;
+	for (const Token &token : p_tokens) {
+		if (token.type != Token::IDENTIFIER && token.type != Token::ANNOTATION) {
+			continue;
+		}
+		StringName name = token.get_identifier();
+		if (!names.has(name)) {
+			names.insert(name);
+			size += (String(name).length() + 1) * 4;
+		}
+	}
+	return size;
+}
+
+// Shortest name not used by the script, counting a, ..., Z, aa, ... and skipping keywords,
+// builtin types and utility functions that a local can't or shouldn't shadow. A leading
+// underscore is kept, it silences the unused variable and parameter warnings.
+StringName next_free_name(uint32_t &r_counter, const HashSet<StringName> &p_used, const String &p_prefix) {
+	static const char *alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	static const char *reserved[] = { "as", "if", "in", "is", "or", "PI", "and", "for", "not", "var", "INF", "NAN",
+		"TAU", "get", "set", "int", "str", "abs", "cos", "sin", "tan", "exp", "log", "max", "min", "pow", "len", "ord" };
+	while (true) {
+		String name;
+		uint32_t n = r_counter++;
+		while (true) {
+			name = String::chr(alphabet[n % 52]) + name;
+			if (n < 52) {
+				break;
+			}
+			n = n / 52 - 1;
+		}
+		name = p_prefix + name;
+		bool is_reserved = false;
+		for (const char *word : reserved) {
+			is_reserved = is_reserved || name == word;
+		}
+		StringName result = name;
+		if (!is_reserved && !p_used.has(result)) {
+			return result;
+		}
+	}
+}
+
+// Removes the tokens marked in r_removed, which p_ranges lists as pairs of first and past the
+// end token of the statements they belong to. A block they leave empty gets a pass in place of
+// its first removed statement.
+void remove_statements(LocalVector<Token> &r_tokens, const TokenLayout &p_layout,
+		const LocalVector<uint32_t> &p_ranges, LocalVector<uint8_t> &r_removed) {
+	uint32_t count = r_tokens.size();
+
+	// Blocks left with no statement. An indented block is found from the line that opens it, the
+	// closest one before with less indentation, and one on the same line from its colon.
+	HashSet<uint32_t> filled_blocks;
+	for (uint32_t s = 0; s < p_ranges.size(); s += 2) {
+		uint32_t first = p_ranges[s];
+		uint32_t block = 0;
+		uint32_t block_begin = 0;
+		uint32_t block_end = 0;
+		if (p_layout.line_start[first]) {
+			bool found = false;
+			for (uint32_t i = first; i > 0 && !found; i--) {
+				found = p_layout.line_start[i - 1] && p_layout.depth[i - 1] == 0 && p_layout.indent[i - 1] < p_layout.indent[first];
+				block = i - 1;
+			}
+			if (!found) {
+				continue; // Not in a block.
+			}
+			block_begin = block + 1;
+			while (block_begin < count && !(p_layout.line_start[block_begin] && p_layout.depth[block_begin] == 0)) {
+				block_begin++;
+			}
+			block_end = p_layout.block_end(block, true, count);
+		} else if (r_tokens[first - 1].type == Token::COLON) {
+			block = first - 1;
+			block_begin = first;
+			block_end = first + 1;
+			while (block_end < count && !(p_layout.line_start[block_end] && p_layout.depth[block_end] == 0)) {
+				block_end++;
+			}
+		} else {
+			continue; // After a semicolon, the statement before is in the same block.
+		}
+		if (filled_blocks.has(block)) {
+			continue;
+		}
+		bool empty = true;
+		for (uint32_t i = block_begin; i < block_end && empty; i++) {
+			empty = r_removed[i];
+		}
+		if (empty) {
+			Token pass(Token::PASS);
+			pass.start_line = r_tokens[first].start_line;
+			pass.end_line = r_tokens[first].start_line;
+			pass.start_column = r_tokens[first].start_column;
+			pass.end_column = r_tokens[first].start_column + 4;
+			r_tokens[first] = pass;
+			r_removed[first] = false;
+			filled_blocks.insert(block);
+		}
+	}
+
+	// A statement kept after a removed one on the same line now starts it, at its indentation.
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (r_removed[i]) {
+			continue;
+		}
+		if (!p_layout.line_start[i] && (kept == 0 || r_tokens[kept - 1].end_line < r_tokens[i].start_line)) {
+			r_tokens[i].start_column = p_layout.indent[i];
+		}
+		if (kept != i) {
+			r_tokens[kept] = r_tokens[i];
+		}
+		kept++;
+	}
+	r_tokens.resize(kept);
+}
+
+} // namespace
+
+uint32_t TokenTransforms::minify_locals(LocalVector<Token> &r_tokens, const Vector<int> &p_continuation_lines) {
+	uint32_t count = r_tokens.size();
+	for (const Token &token : r_tokens) {
+		if (token.type == Token::ERROR) {
+			return 0; // Won't compile anyway, keep the error as it is.
+		}
+	}
+	TokenLayout layout;
+	layout.build(r_tokens, p_continuation_lines);
+
+	// Names after $ and unique node names after %, including the rest of the path.
+	LocalVector<uint8_t> node_names;
+	node_names.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		node_names[i] = false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		bool unique_node = r_tokens[i].type == Token::PERCENT && (i == 0 || !r_tokens[i - 1].can_precede_bin_op());
+		if (r_tokens[i].type != Token::DOLLAR && !unique_node) {
+			continue;
+		}
+		uint32_t j = i + 1;
+		while (j < count && r_tokens[j].is_node_name()) {
+			node_names[j] = true;
+			if (j + 2 >= count || r_tokens[j + 1].type != Token::SLASH) {
+				break;
+			}
+			j += 2;
+		}
+	}
+
+	// Methods, from FUNC to the end of their block. Names used anywhere outside of them, method
+	// names, and words in strings are kept. Every name is collected so new ones don't collide.
+	LocalVector<uint32_t> methods; // Pairs of first and past the end token.
+	HashSet<StringName> kept;
+	HashSet<StringName> used;
+	uint32_t method_end = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		const Token &token = r_tokens[i];
+		if (i >= method_end && layout.is_method(i)) {
+			method_end = layout.block_end(i, true, count);
+			methods.push_back(i);
+			methods.push_back(method_end);
+			if (i + 1 < count && r_tokens[i + 1].type == Token::IDENTIFIER) {
+				kept.insert(r_tokens[i + 1].get_identifier());
+			}
+		}
+		if (token.type == Token::IDENTIFIER || token.type == Token::ANNOTATION) {
+			used.insert(token.get_identifier());
+			if (i >= method_end) {
+				kept.insert(token.get_identifier());
+			}
+		} else if (token.type == Token::LITERAL) {
+			Variant::Type type = token.literal.get_type();
+			if (type == Variant::STRING || type == Variant::STRING_NAME || type == Variant::NODE_PATH) {
+				add_string_words(token.literal, kept);
+			}
+		}
+	}
+	for (const StringName &name : kept) {
+		used.insert(name);
+	}
+
+	uint32_t size_before = identifier_table_size(r_tokens);
+	bool renamed_any = false;
+	for (uint32_t m = 0; m < methods.size(); m += 2) {
+		uint32_t start = methods[m];
+		uint32_t end = methods[m + 1];
+
+		// Declarations: var and const from the next statement to the end of their block, for
+		// variables in their body, and parameters in the body of their method or lambda.
+		LocalVector<LocalDeclaration> declarations;
+		for (uint32_t i = start; i < end; i++) {
+			const Token &token = r_tokens[i];
+			bool named = i + 1 < end && r_tokens[i + 1].type == Token::IDENTIFIER;
+			if ((token.type == Token::VAR || token.type == Token::CONST) && named) {
+				bool inline_block = !layout.line_start[i] && r_tokens[i - 1].type == Token::COLON;
+				declarations.push_back({ r_tokens[i + 1].get_identifier(), i + 1,
+						layout.next_statement(i + 1, end), layout.block_end(i, inline_block, end) });
+			} else if (token.type == Token::FOR && named) {
+				declarations.push_back({ r_tokens[i + 1].get_identifier(), i + 1, i + 1, layout.block_end(i, true, end) });
+			} else if (token.type == Token::FUNC) {
+				uint32_t scope_end = i == start ? end : layout.block_end(i, true, end);
+				uint32_t j = named ? i + 2 : i + 1;
+				if (j >= end || r_tokens[j].type != Token::PARENTHESIS_OPEN) {
+					continue;
+				}
+				int parameter_depth = layout.depth[j] + 1;
+				for (uint32_t k = j + 1; k < end && layout.depth[k] >= parameter_depth; k++) {
+					Token::Type previous = r_tokens[k - 1].type;
+					if (layout.depth[k] == parameter_depth && r_tokens[k].type == Token::IDENTIFIER &&
+							(previous == Token::PARENTHESIS_OPEN || previous == Token::COMMA)) {
+						declarations.push_back({ r_tokens[k].get_identifier(), k, i, scope_end });
+					}
+				}
+			}
+		}
+
+		// A name is only renamed when every reference to it is in the scope of one of its declarations,
+		// otherwise some reference is to a member, global or inherited name.
+		HashMap<StringName, bool> candidates;
+		for (const LocalDeclaration &declaration : declarations) {
+			if (!kept.has(declaration.name)) {
+				candidates.insert(declaration.name, true);
+			}
+		}
+		if (candidates.is_empty()) {
+			continue;
+		}
+		for (uint32_t i = start; i < end; i++) {
+			if (!is_variable_reference(r_tokens, layout, node_names, i)) {
+				continue;
+			}
+			HashMap<StringName, bool>::Iterator candidate = candidates.find(r_tokens[i].get_identifier());
+			if (!candidate || !candidate->value) {
+				continue;
+			}
+			bool in_scope = false;
+			for (const LocalDeclaration &declaration : declarations) {
+				if (declaration.name == candidate->key &&
+						(declaration.token == i || (i >= declaration.scope_start && i < declaration.scope_end))) {
+					in_scope = true;
+					break;
+				}
+			}
+			candidate->value = in_scope;
+		}
+
+		// Short names in order of declaration, the same ones are reused by every method.
+		HashMap<StringName, StringName> renames;
+		uint32_t name_counter = 0;
+		for (const LocalDeclaration &declaration : declarations) {
+			HashMap<StringName, bool>::ConstIterator candidate = candidates.find(declaration.name);
+			if (candidate && candidate->value && !renames.has(declaration.name)) {
+				String prefix = String(declaration.name).begins_with("_") ? "_" : "";
+				renames.insert(declaration.name, next_free_name(name_counter, used, prefix));
+			}
+		}
+		for (uint32_t i = start; i < end; i++) {
+			if (!is_variable_reference(r_tokens, layout, node_names, i)) {
+				continue;
+			}
+			HashMap<StringName, StringName>::ConstIterator rename = renames.find(r_tokens[i].get_identifier());
+			if (rename) {
+				r_tokens[i].literal = rename->value;
+				renamed_any = true;
+			}
+		}
+	}
+
+	return renamed_any ? size_before - identifier_table_size(r_tokens) : 0;
+}
+
+uint32_t TokenTransforms::strip_statements(LocalVector<Token> &r_tokens, const Vector<int> &p_continuation_lines,
+		bool p_debug, const Vector<StringName> &p_calls) {
+	uint32_t count = r_tokens.size();
+	for (const Token &token : r_tokens) {
+		if (token.type == Token::ERROR) {
+			return 0;
+		}
+	}
+	TokenLayout layout;
+	layout.build(r_tokens, p_continuation_lines);
+
+	// Statements start a line, or follow a semicolon, or the colon of a block on the same line.
+	LocalVector<uint32_t> stripped; // Pairs of first and past the end token.
+	LocalVector<uint8_t> removed;
+	removed.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		removed[i] = false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		if (layout.depth[i] != 0) {
+			continue;
+		}
+		Token::Type previous = i > 0 ? r_tokens[i - 1].type : Token::EMPTY;
+		if (!layout.line_start[i] && previous != Token::SEMICOLON && previous != Token::COLON) {
+			continue;
+		}
+		uint32_t end = layout.next_statement(i, count);
+		const Token &token = r_tokens[i];
+		bool strip = p_debug && (token.type == Token::ASSERT || token.type == Token::BREAKPOINT);
+		if (!strip && token.type == Token::IDENTIFIER && i + 1 < end && r_tokens[i + 1].type == Token::PARENTHESIS_OPEN &&
+				p_calls.has(token.get_identifier())) {
+			// Nothing may follow the call but a semicolon, its result could be used otherwise.
+			uint32_t close = i + 2;
+			while (close < end && (layout.depth[close] != 1 || r_tokens[close].type != Token::PARENTHESIS_CLOSE)) {
+				close++;
+			}
+			strip = close + 1 == end || (close + 2 == end && r_tokens[close + 1].type == Token::SEMICOLON);
+		}
+		if (!strip) {
+			continue;
+		}
+		stripped.push_back(i);
+		stripped.push_back(end);
+		for (uint32_t j = i; j < end; j++) {
+			removed[j] = true;
+		}
+		i = end - 1;
+	}
+	if (stripped.is_empty()) {
+		return 0;
+	}
+
+	remove_statements(r_tokens, layout, stripped, removed);
+	return stripped.size() / 2;
+}
+
+uint32_t TokenTransforms::filter_features(LocalVector<Token> &r_tokens, const Vector<int> &p_continuation_lines,
+		const Vector<StringName> &p_features) {
+	uint32_t count = r_tokens.size();
+	TokenLayout layout;
+	layout.build(r_tokens, p_continuation_lines);
+
+	const StringName if_feature = "@if_feature";
+	LocalVector<uint32_t> ranges;
+	LocalVector<uint8_t> removed;
+	removed.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		removed[i] = false;
+	}
+	uint32_t excluded = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (r_tokens[i].type != Token::ANNOTATION || r_tokens[i].get_identifier() != if_feature) {
+			continue;
+		}
+
+		// One or more feature names, each one enabled, or disabled when prefixed with "!".
+		uint32_t close = i + 1;
+		bool valid = close < count && r_tokens[close].type == Token::PARENTHESIS_OPEN;
+		bool included = true;
+		while (valid) {
+			close++;
+			valid = close < count && r_tokens[close].type == Token::LITERAL && r_tokens[close].literal.get_type() == Variant::STRING;
+			if (!valid) {
+				break;
+			}
+			String feature = r_tokens[close].literal;
+			bool negated = feature.begins_with("!");
+			bool enabled = p_features.has(negated ? feature.substr(1) : feature);
+			included = included && enabled != negated;
+			close++;
+			if (close < count && r_tokens[close].type == Token::PARENTHESIS_CLOSE) {
+				break;
+			}
+			valid = close < count && r_tokens[close].type == Token::COMMA;
+		}
+		if (!valid) {
+			// Left for the parser to report, as the tokenizer does with its own errors.
+			r_tokens[i].type = Token::ERROR;
+			r_tokens[i].literal = String("Expected one or more feature name strings in \"@if_feature\" annotation.");
+			continue;
+		}
+
+		// The statement it annotates, after any other annotations, with its block and for an if,
+		// the elif and else branches that follow.
+		uint32_t statement = close + 1;
+		while (statement < count && r_tokens[statement].type == Token::ANNOTATION) {
+			statement++;
+			if (statement < count && r_tokens[statement].type == Token::PARENTHESIS_OPEN) {
+				int annotation_depth = layout.depth[statement];
+				statement++;
+				while (statement < count && layout.depth[statement] > annotation_depth) {
+					statement++;
+				}
+			}
+		}
+		uint32_t end = close + 1;
+		if (!included && statement < count) {
+			end = layout.block_end(statement, true, count);
+			while (r_tokens[statement].type == Token::IF && end < count && layout.line_start[end] &&
+					layout.indent[end] == layout.indent[statement] &&
+					(r_tokens[end].type == Token::ELIF || r_tokens[end].type == Token::ELSE)) {
+				end = layout.block_end(end, true, count);
+			}
+			excluded++;
+		}
+		ranges.push_back(i);
+		ranges.push_back(end);
+		for (uint32_t j = i; j < end; j++) {
+			removed[j] = true;
+		}
+		i = end - 1;
+	}
+	if (ranges.is_empty()) {
+		return 0;
+	}
+
+	remove_statements(r_tokens, layout, ranges, removed);
+	return excluded;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Ayzurus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef TOKEN_TRANSFORMS_H
+#define TOKEN_TRANSFORMS_H
+
+#include "gdscript_tokenizer.h"
+#include <godot_cpp/templates/local_vector.hpp>
+
+namespace godot {
+
+// Rewrites of the token stream that happen before the tokens are encoded.
+// There is no parser here, scopes and statements are worked out from the tokens alone: the
+// bracket depth, and the indentation of the first token on each line, which is what the
+// lines and columns tables of the bytecode store in place of INDENT and DEDENT tokens.
+// Anything that can't be proven safe from that is left as it is.
+class TokenTransforms {
+public:
+	typedef GDScriptTokenizer::Token Token;
+
+	// Renames the local variables, constants and parameters of each function, lambdas
+	// included, to the shortest names that appear nowhere in the script.
+	// Names that are also used outside of functions, as function names, after a period, in
+	// node paths, as dictionary keys or inside any string are kept, so members, exports,
+	// class_name and everything reachable through get() or call() stay untouched.
+	// Returns the bytes saved in the identifier table.
+	static uint32_t minify_locals(LocalVector<Token> &r_tokens, const Vector<int> &p_continuation_lines);
+
+	// Removes statements led by assert or breakpoint when p_debug is set, and statements that are
+	// only a call to one of p_calls, in function bodies. A block left empty gets a pass in place of
+	// its first removed statement. Statements inside brackets, that is in lambdas passed as
+	// arguments, are kept. Returns the number of statements removed.
+	static uint32_t strip_statements(LocalVector<Token> &r_tokens, const Vector<int> &p_continuation_lines,
+			bool p_debug, const Vector<StringName> &p_calls);
+
+	// Applies @if_feature("name", "!name", ...) annotations: the statement or block after one is
+	// kept when every listed feature is in p_features, or isn't for names prefixed with "!", and
+	// removed otherwise, along with the elif and else branches of an if. The annotations come from
+	// "#@if_feature" comments, see GDScriptTokenizerText::set_feature_directives(), and are always
+	// removed since the engine doesn't know them. A block left empty gets a pass.
+	// Returns the number of statements or blocks removed.
+	static uint32_t filter_features(LocalVector<Token> &r_tokens, const Vector<int> &p_continuation_lines,
+			const Vector<StringName> &p_features);
+};
+
+} //namespace godot
+
+#endif // TOKEN_TRANSFORMS_H
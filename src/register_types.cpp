@@ -22,14 +22,28 @@
 
 #include "register_types.h"
 #include "bytecode_compiler.h"
+#include "bytecode_export_plugin.h"
 #include <gdextension_interface.h>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/core/defs.hpp>
 #include <godot_cpp/godot.hpp>
 
+#ifdef TOOLS_ENABLED
+#include <godot_cpp/classes/editor_plugin_registration.hpp>
+#endif
+
 using namespace godot;
 
 void initialize_gdbc(ModuleInitializationLevel p_level) {
+#ifdef TOOLS_ENABLED
+	if (p_level == MODULE_INITIALIZATION_LEVEL_EDITOR) {
+		GDREGISTER_INTERNAL_CLASS(BytecodeSaveCompiler);
+		GDREGISTER_INTERNAL_CLASS(BytecodeExportPlugin);
+		GDREGISTER_INTERNAL_CLASS(BytecodeEditorPlugin);
+		EditorPlugins::add_by_type<BytecodeEditorPlugin>();
+		return;
+	}
+#endif
 	if (p_level != MODULE_INITIALIZATION_LEVEL_CORE) {
 		return;
 	}
@@ -37,6 +51,12 @@ void initialize_gdbc(ModuleInitializationLevel p_level) {
 }
 
 void uninitialize_gdbc(ModuleInitializationLevel p_level) {
+#ifdef TOOLS_ENABLED
+	if (p_level == MODULE_INITIALIZATION_LEVEL_EDITOR) {
+		EditorPlugins::remove_by_type<BytecodeEditorPlugin>();
+		return;
+	}
+#endif
 	if (p_level != MODULE_INITIALIZATION_LEVEL_CORE) {
 		return;
 	}